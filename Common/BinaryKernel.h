@@ -0,0 +1,223 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <cstring>
+#include "GrayKernel.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    // 1 bit 一個像素的二值圖，每列由左至右從 byte 的最低位元開始排列
+    // 每列長度補齊到 16 byte 的倍數，多出的位元固定為 0
+    class PackedBinary
+    {
+    public:
+        PackedBinary() {}
+
+        PackedBinary(int rows, int cols) {
+            this->Create(rows, cols);
+        }
+
+        void Create(int rows, int cols) {
+            _rows = rows;
+            _cols = cols;
+            _stride = StrideOf(cols);
+            _bits.assign((size_t)_stride * rows, 0);
+        }
+
+        int Rows() const { return _rows; }
+        int Cols() const { return _cols; }
+        int Stride() const { return _stride; }   // 每列 byte 數
+        static int StrideOf(int cols) { return ((cols + 127) / 128) * 16; }
+        bool Empty() const { return _bits.empty(); }
+
+        uchar* Row(int row) { return _bits.data() + (size_t)_stride * row; }
+        const uchar* Row(int row) const { return _bits.data() + (size_t)_stride * row; }
+
+        bool Get(int row, int col) const {
+            return (Row(row)[col >> 3] >> (col & 7)) & 1;
+        }
+
+        void Set(int row, int col, bool value) {
+            uchar& bits = Row(row)[col >> 3];
+            bits = value ? (uchar)(bits | (1 << (col & 7))) : (uchar)(bits & ~(1 << (col & 7)));
+        }
+
+        // 展開一列成 0 / foreground
+        void UnpackRow(int row, uchar* dst, uchar foreground = 255) const {
+            const uchar* bits = Row(row);
+            for (int col = 0; col < _cols; col++)
+                dst[col] = ((bits[col >> 3] >> (col & 7)) & 1) ? foreground : 0;
+        }
+
+        // 展開成 CV_8UC1 (0 / foreground)
+        Mat Unpack(uchar foreground = 255) const {
+            Mat binaryImage(_rows, _cols, CV_8UC1);
+            for (int row = 0; row < _rows; row++)
+                this->UnpackRow(row, binaryImage.ptr<uchar>(row), foreground);
+            return binaryImage;
+        }
+
+        // 由 CV_8UC1 壓縮，非 0 為 1
+        static PackedBinary Pack(const Mat& binaryImage) {
+            CV_Assert(binaryImage.type() == CV_8UC1);
+            PackedBinary packed(binaryImage.rows, binaryImage.cols);
+            for (int row = 0; row < binaryImage.rows; row++) {
+                const uchar* src = binaryImage.ptr<uchar>(row);
+                uchar* bits = packed.Row(row);
+                for (int col = 0; col < binaryImage.cols; col++)
+                    if (src[col])
+                        bits[col >> 3] |= (uchar)(1 << (col & 7));
+            }
+            return packed;
+        }
+
+    private:
+        int _rows = 0;
+        int _cols = 0;
+        int _stride = 0;
+        std::vector<uchar> _bits;
+    };
+
+    namespace detail {
+        // 一列 BGR 直接轉成二值 (gray > threshold)，不產生灰階圖
+        // packed = true 時 dst 為 1 bit 一個像素 (需預先清為 0)，否則為 0 / 255
+        typedef void (*BinaryRowFunc)(const uchar* bgr, uchar* dst, int width, const int* weights, uchar threshold, bool packed);
+
+        inline void BinaryRowScalar(const uchar* bgr, uchar* dst, int width, const int* weights, uchar threshold, bool packed) {
+            for (int x = 0; x < width; x++, bgr += 3) {
+                bool isForeground = DivideBy100(weights[0] * bgr[0] + weights[1] * bgr[1] + weights[2] * bgr[2]) > threshold;
+                if (!packed)
+                    dst[x] = isForeground ? 255 : 0;
+                else if (isForeground)
+                    dst[x >> 3] |= (uchar)(1 << (x & 7));
+            }
+        }
+
+#ifdef IMAGE_KERNEL_X86
+        // gray > threshold 的 byte mask (0xFF / 0x00)
+        IMAGE_KERNEL_TARGET("sse2")
+        inline __m128i GreaterSse2(__m128i gray, __m128i threshold) {
+            __m128i notGreater = _mm_cmpeq_epi8(_mm_subs_epu8(gray, threshold), _mm_setzero_si128());
+            return _mm_xor_si128(notGreater, _mm_set1_epi8(-1));
+        }
+
+        // 每次處理 32 個像素，packed 時以 movemask 取出 32 bit
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void BinaryRowSse2(const uchar* bgr, uchar* dst, int width, const int* weights, uchar threshold, bool packed) {
+            const __m128i wb = _mm_set1_epi16((short)weights[0]);
+            const __m128i wg = _mm_set1_epi16((short)weights[1]);
+            const __m128i wr = _mm_set1_epi16((short)weights[2]);
+            const __m128i limit = _mm_set1_epi8((char)threshold);
+            int x = 0;
+            for (; x + 32 <= width; x += 32) {
+                __m128i gray0, gray1;
+                Gray32Sse2(bgr + x * 3, wb, wg, wr, gray0, gray1);
+                __m128i mask0 = GreaterSse2(gray0, limit);
+                __m128i mask1 = GreaterSse2(gray1, limit);
+                if (packed) {
+                    uint32_t bits = (uint32_t)_mm_movemask_epi8(mask0) | ((uint32_t)_mm_movemask_epi8(mask1) << 16);
+                    memcpy(dst + (x >> 3), &bits, sizeof(bits));
+                }
+                else {
+                    _mm_storeu_si128((__m128i*)(dst + x), mask0);
+                    _mm_storeu_si128((__m128i*)(dst + x + 16), mask1);
+                }
+            }
+            // packed 時 x 為 32 的倍數，剩下的位元從新的 byte 開始
+            BinaryRowScalar(bgr + x * 3, packed ? dst + (x >> 3) : dst + x, width - x, weights, threshold, packed);
+        }
+
+        IMAGE_KERNEL_TARGET("avx2")
+        inline __m256i GreaterAvx2(__m256i gray, __m256i threshold) {
+            __m256i notGreater = _mm256_cmpeq_epi8(_mm256_subs_epu8(gray, threshold), _mm256_setzero_si256());
+            return _mm256_xor_si256(notGreater, _mm256_set1_epi8(-1));
+        }
+
+        // 每次處理 64 個像素
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void BinaryRowAvx2(const uchar* bgr, uchar* dst, int width, const int* weights, uchar threshold, bool packed) {
+            const __m256i wb = _mm256_set1_epi16((short)weights[0]);
+            const __m256i wg = _mm256_set1_epi16((short)weights[1]);
+            const __m256i wr = _mm256_set1_epi16((short)weights[2]);
+            const __m256i limit = _mm256_set1_epi8((char)threshold);
+            int x = 0;
+            for (; x + 64 <= width; x += 64) {
+                __m256i gray0, gray1;
+                Gray64Avx2(bgr + x * 3, wb, wg, wr, gray0, gray1);
+                __m256i mask0 = GreaterAvx2(gray0, limit);
+                __m256i mask1 = GreaterAvx2(gray1, limit);
+                if (packed) {
+                    uint32_t bits[2] = { (uint32_t)_mm256_movemask_epi8(mask0), (uint32_t)_mm256_movemask_epi8(mask1) };
+                    memcpy(dst + (x >> 3), bits, sizeof(bits));
+                }
+                else {
+                    _mm256_storeu_si256((__m256i*)(dst + x), mask0);
+                    _mm256_storeu_si256((__m256i*)(dst + x + 32), mask1);
+                }
+            }
+            BinaryRowSse2(bgr + x * 3, packed ? dst + (x >> 3) : dst + x, width - x, weights, threshold, packed);
+        }
+#endif
+
+        inline BinaryRowFunc SelectBinaryRow() {
+            static const BinaryRowFunc func = []() -> BinaryRowFunc {
+#ifdef IMAGE_KERNEL_X86
+                if (simd::CpuSupportsAvx2())
+                    return BinaryRowAvx2;
+                if (simd::CpuSupportsSse2())
+                    return BinaryRowSse2;
+#endif
+                return BinaryRowScalar;
+            }();
+            return func;
+        }
+    }
+
+    // BGR 直接二值化 (gray > threshold 為 255)，輸出 CV_8UC1，結果與先 ConvertBgrToGray 再比較相同
+    inline Mat ConvertBgrToBinary(const Mat& colorImage, uchar threshold = 128, GrayWeights grayWeights = GrayWeights::Luma) {
+        CV_Assert(colorImage.type() == CV_8UC3);
+        Mat binaryImage(colorImage.size(), CV_8UC1);
+        int weights[3];
+        detail::WeightsOf(grayWeights, weights);
+        detail::BinaryRowFunc binaryRow = detail::SelectBinaryRow();
+        ParallelFor(0, colorImage.rows, RowGrain(colorImage.rows, (size_t)colorImage.cols * 4), [&](int begin, int end) {
+            for (int row = begin; row < end; row++)
+                binaryRow(colorImage.ptr<uchar>(row), binaryImage.ptr<uchar>(row), colorImage.cols, weights, threshold, false);
+        });
+        return binaryImage;
+    }
+
+    // BGR 直接二值化成 1 bit 一個像素
+    inline PackedBinary ConvertBgrToPackedBinary(const Mat& colorImage, uchar threshold = 128, GrayWeights grayWeights = GrayWeights::Luma) {
+        CV_Assert(colorImage.type() == CV_8UC3);
+        PackedBinary packed(colorImage.rows, colorImage.cols);
+        int weights[3];
+        detail::WeightsOf(grayWeights, weights);
+        detail::BinaryRowFunc binaryRow = detail::SelectBinaryRow();
+        ParallelFor(0, colorImage.rows, RowGrain(colorImage.rows, (size_t)colorImage.cols * 3 + packed.Stride()), [&](int begin, int end) {
+            for (int row = begin; row < end; row++)
+                binaryRow(colorImage.ptr<uchar>(row), packed.Row(row), colorImage.cols, weights, threshold, true);
+        });
+        return packed;
+    }
+
+    // 灰階圖二值化 (只看第一個通道)，dstChannels = 3 輸出三通道相同的 CV_8UC3
+    inline Mat ThresholdGray(const Mat& grayImage, uchar threshold = 128, int dstChannels = 1) {
+        CV_Assert(grayImage.depth() == CV_8U && (dstChannels == 1 || dstChannels == 3));
+        const int srcChannels = grayImage.channels();
+        Mat binaryImage(grayImage.size(), CV_8UC(dstChannels));
+        ParallelFor(0, grayImage.rows, RowGrain(grayImage.rows, (size_t)grayImage.cols * (srcChannels + dstChannels)), [&](int begin, int end) {
+            for (int row = begin; row < end; row++) {
+                const uchar* src = grayImage.ptr<uchar>(row);
+                uchar* dst = binaryImage.ptr<uchar>(row);
+                for (int col = 0; col < grayImage.cols; col++) {
+                    uchar value = src[col * srcChannels] > threshold ? 255 : 0;
+                    for (int k = 0; k < dstChannels; k++)
+                        dst[col * dstChannels + k] = value;
+                }
+            }
+        });
+        return binaryImage;
+    }
+}
@@ -0,0 +1,111 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "FilterKernel.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    namespace detail {
+        // 係數為 Coefficient 的一個 tap，係數 0 不讀取像素、±1 不做乘法
+        template <int Coefficient, typename Sum>
+        inline Sum WeightedTap(const uchar* src) {
+            if constexpr (Coefficient == 0)
+                return 0;
+            else if constexpr (Coefficient == 1)
+                return (Sum)src[0];
+            else if constexpr (Coefficient == -1)
+                return (Sum)-(Sum)src[0];
+            else
+                return (Sum)(Coefficient * src[0]);
+        }
+    }
+
+    // 執行期的 kernel (size x size)，係數依列連續存放
+    // 只保留非 0 的 tap，每個 tap 對整列做一次乘加，內層迴圈為連續記憶體可由編譯器向量化
+    class FlatKernel
+    {
+    public:
+        FlatKernel(const std::vector<int>& weights, int size) : _size(size), _weights(weights) {
+            CV_Assert(size > 0 && (size & 1) && (int)weights.size() == size * size);
+            for (int m = 0; m < size; m++)
+                for (int n = 0; n < size; n++)
+                    if (weights[(size_t)m * size + n] != 0)
+                        _taps.push_back({ m, n, weights[(size_t)m * size + n] });
+        }
+
+        int Size() const { return _size; }
+
+        const std::vector<int>& Weights() const { return _weights; }
+
+        // dst[col] 為以 rows 目前所在列、第 col 行為中心的卷積結果 (rows 需以相同的 mask 建立)
+        template <typename Sum>
+        void ConvolveRow(const BorderedRows& rows, int cols, Sum* dst) const {
+            std::fill(dst, dst + cols, (Sum)0);
+            for (const Tap& tap : _taps) {
+                const uchar* src = rows.Row(tap.row) + tap.col;
+                const int weight = tap.weight;
+                for (int col = 0; col < cols; col++)
+                    dst[col] = (Sum)(dst[col] + weight * src[col]);
+            }
+        }
+
+    private:
+        struct Tap
+        {
+            int row, col, weight;
+        };
+
+        int _size;
+        std::vector<int> _weights;
+        std::vector<Tap> _taps;
+    };
+
+    // 編譯期固定大小與係數的 kernel (KernelSize x KernelSize，係數依列排列)
+    // 每個 tap 在內層迴圈中完全展開，係數 0 的 tap 不產生運算，各行之間沒有相依可由編譯器向量化
+    template <int KernelSize, int... Coefficients>
+    class FixedKernel
+    {
+    public:
+        static_assert(KernelSize > 0 && (KernelSize & 1), "kernel size must be odd");
+        static_assert(sizeof...(Coefficients) == KernelSize * KernelSize, "kernel needs KernelSize * KernelSize coefficients");
+
+        static constexpr int COEFFICIENTS[] = { Coefficients... };
+
+        int Size() const { return KernelSize; }
+
+        // 與執行期 kernel 的係數相同時可改用這個 kernel
+        static bool Equals(const FlatKernel& kernel) {
+            return kernel.Size() == KernelSize && std::equal(kernel.Weights().begin(), kernel.Weights().end(), COEFFICIENTS);
+        }
+
+        template <typename Sum>
+        void ConvolveRow(const BorderedRows& rows, int cols, Sum* dst) const {
+            const uchar* src[KernelSize];
+            for (int m = 0; m < KernelSize; m++)
+                src[m] = rows.Row(m);
+            ConvolveTaps(src, cols, dst, std::make_index_sequence<KernelSize * KernelSize>());
+        }
+
+    private:
+        template <typename Sum, size_t... Taps>
+        static void ConvolveTaps(const uchar* const* src, int cols, Sum* dst, std::index_sequence<Taps...>) {
+            for (int col = 0; col < cols; col++)
+                dst[col] = (Sum)(0 + ... + detail::WeightedTap<COEFFICIENTS[Taps], Sum>(src[Taps / KernelSize] + col + Taps % KernelSize));
+        }
+    };
+
+    // hw5 使用的邊緣偵測 kernel
+    namespace kernels {
+        typedef FixedKernel<3, -1, 0, 1, -2, 0, 2, -1, 0, 1> SobelX;
+        typedef FixedKernel<3, -1, -2, -1, 0, 0, 0, 1, 2, 1> SobelY;
+        typedef FixedKernel<3, -1, 0, 1, -1, 0, 1, -1, 0, 1> PrewittX;
+        typedef FixedKernel<3, -1, -1, -1, 0, 0, 0, 1, 1, 1> PrewittY;
+        typedef FixedKernel<3, 0, 1, 0, 1, -4, 1, 0, 1, 0> Laplacian4;
+        typedef FixedKernel<3, 1, 1, 1, 1, -8, 1, 1, 1, 1> Laplacian8;
+        typedef FixedKernel<3, 0, 0, 0, 0, 0, 0, 0, 0, 0> Zero3;
+    }
+}
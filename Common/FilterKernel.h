@@ -0,0 +1,546 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    // 超出圖片範圍的像素取值方式
+    enum class BorderMode {
+        Replicate,  // 複製最外圈像素 aaa|abcd|ddd
+        Zero,       // 補 0
+        Reflect,    // 以最外圈像素為軸鏡射 cb|abcd|cb
+        Wrap,       // 取另一側 cd|abcd|ab
+    };
+
+    namespace detail {
+        // x / divisor 以 (x * multiplier) >> shift 計算，對 0 ~ maxValue 皆成立
+        // multiplier = ceil(2^shift / divisor)，誤差 e = multiplier * divisor - 2^shift 滿足 maxValue * e < 2^shift 時與整數除法相同
+        struct ConstantDivisor
+        {
+            uint64_t multiplier = 1;
+            int shift = 0;
+
+            ConstantDivisor() {}
+
+            ConstantDivisor(uint32_t divisor, uint32_t maxValue, int minShift = 0) {
+                for (shift = minShift; shift < 48; shift++) {
+                    multiplier = (((uint64_t)1 << shift) + divisor - 1) / divisor;
+                    const uint64_t error = multiplier * divisor - ((uint64_t)1 << shift);
+                    if ((uint64_t)maxValue * error < ((uint64_t)1 << shift))
+                        return;
+                }
+            }
+
+            // 可用 16 bit 乘法取高位 (mulhi) 計算
+            bool FitsUint16() const {
+                return shift >= 16 && multiplier <= 0xFFFF;
+            }
+
+            uint32_t Divide(uint32_t x) const {
+                return (uint32_t)((x * multiplier) >> shift);
+            }
+        };
+
+        inline int ClampIndex(int index, int size) {
+            return std::min(std::max(index, 0), size - 1);
+        }
+
+        // 超出範圍的索引依邊界模式對應到範圍內，Zero 時回傳 -1
+        inline int BorderIndex(int index, int size, BorderMode border) {
+            if (index >= 0 && index < size)
+                return index;
+            switch (border) {
+            case BorderMode::Zero:
+                return -1;
+            case BorderMode::Reflect: {
+                if (size == 1)
+                    return 0;
+                const int period = 2 * (size - 1);
+                index %= period;
+                if (index < 0)
+                    index += period;
+                return index < size ? index : period - index;
+            }
+            case BorderMode::Wrap:
+                index %= size;
+                return index < 0 ? index + size : index;
+            default:
+                return ClampIndex(index, size);
+            }
+        }
+
+        // 第 row 列 (可超出範圍) 的第一個通道展開成連續的 cols + 2 * radius 個像素
+        // 中間直接複製，只有兩側 radius 個像素依邊界模式取值
+        inline void LoadBorderedRow(const Mat& image, int row, int radius, BorderMode border, uchar* dst) {
+            const int cols = image.cols, channels = image.channels();
+            const int sourceRow = BorderIndex(row, image.rows, border);
+            if (sourceRow < 0) {
+                memset(dst, 0, cols + 2 * radius);
+                return;
+            }
+            const uchar* src = image.ptr<uchar>(sourceRow);
+            auto at = [src, channels, cols, border](int col) {
+                const int index = BorderIndex(col, cols, border);
+                return index < 0 ? (uchar)0 : src[index * channels];
+            };
+            for (int col = -radius; col < 0; col++)
+                dst[col + radius] = at(col);
+            if (channels == 1)
+                memcpy(dst + radius, src, cols);
+            else
+                for (int col = 0; col < cols; col++)
+                    dst[col + radius] = src[col * channels];
+            for (int col = cols; col < cols + radius; col++)
+                dst[col + radius] = at(col);
+        }
+
+        // 一列結果寫入 dst，dstChannels = 3 時三通道相同
+        inline void StoreGrayRow(const uchar* values, Mat& dst, int row, int dstChannels) {
+            uchar* dstRow = dst.ptr<uchar>(row);
+            if (dstChannels == 1) {
+                if (dstRow != values)
+                    memcpy(dstRow, values, dst.cols);
+                return;
+            }
+            for (int col = 0; col < dst.cols; col++, dstRow += 3)
+                dstRow[0] = dstRow[1] = dstRow[2] = values[col];
+        }
+
+        // 展開過的一列的水平視窗總和
+        template <typename Sum>
+        inline void BoxRowSum(const uchar* padded, int cols, int mask, Sum* sums) {
+            int sum = 0;
+            for (int k = 0; k < mask; k++)
+                sum += padded[k];
+            sums[0] = (Sum)sum;
+            for (int col = 1; col < cols; col++) {
+                sum += padded[col + mask - 1] - padded[col - 1];
+                sums[col] = (Sum)sum;
+            }
+        }
+
+        // mask 為編譯期常數時的水平視窗總和，每行直接加總 Mask 個像素，各行之間沒有相依
+        template <int Mask>
+        inline void FixedBoxRowSumScalar(const uchar* padded, int cols, uint16_t* sums) {
+            for (int col = 0; col < cols; col++) {
+                int sum = 0;
+                for (int k = 0; k < Mask; k++)
+                    sum += padded[col + k];
+                sums[col] = (uint16_t)sum;
+            }
+        }
+
+        typedef void (*BoxRowSumFunc)(const uchar* padded, int cols, uint16_t* sums);
+
+#ifdef IMAGE_KERNEL_X86
+        // 每次處理 16 行，Mask 個錯開的 load 展開成 16 bit 後相加
+        template <int Mask>
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void FixedBoxRowSumSse2(const uchar* padded, int cols, uint16_t* sums) {
+            const __m128i zero = _mm_setzero_si128();
+            int col = 0;
+            for (; col + 16 <= cols; col += 16) {
+                __m128i lo = zero, hi = zero;
+                for (int k = 0; k < Mask; k++) {
+                    const __m128i in = _mm_loadu_si128((const __m128i*)(padded + col + k));
+                    lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(in, zero));
+                    hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(in, zero));
+                }
+                _mm_storeu_si128((__m128i*)(sums + col), lo);
+                _mm_storeu_si128((__m128i*)(sums + col + 8), hi);
+            }
+            FixedBoxRowSumScalar<Mask>(padded + col, cols - col, sums + col);
+        }
+
+        // 每次處理 32 行
+        template <int Mask>
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void FixedBoxRowSumAvx2(const uchar* padded, int cols, uint16_t* sums) {
+            int col = 0;
+            for (; col + 32 <= cols; col += 32) {
+                __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+                for (int k = 0; k < Mask; k++) {
+                    lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(padded + col + k))));
+                    hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(padded + col + k + 16))));
+                }
+                _mm256_storeu_si256((__m256i*)(sums + col), lo);
+                _mm256_storeu_si256((__m256i*)(sums + col + 16), hi);
+            }
+            FixedBoxRowSumSse2<Mask>(padded + col, cols - col, sums + col);
+        }
+#endif
+
+        template <int Mask>
+        inline BoxRowSumFunc SelectFixedBoxRowSum() {
+            static const BoxRowSumFunc func = []() -> BoxRowSumFunc {
+#ifdef IMAGE_KERNEL_X86
+                if (simd::CpuSupportsAvx2())
+                    return FixedBoxRowSumAvx2<Mask>;
+                if (simd::CpuSupportsSse2())
+                    return FixedBoxRowSumSse2<Mask>;
+#endif
+                return FixedBoxRowSumScalar<Mask>;
+            }();
+            return func;
+        }
+
+        // 各行的垂直總和加入新列 added、減去移出的列 slot (之後 slot 改存 added)，並輸出總和 / divisor
+        template <typename Sum>
+        inline void BoxColumnScalar(Sum* colSums, Sum* slot, const Sum* added, uchar* dst, int cols, const ConstantDivisor& divisor) {
+            for (int col = 0; col < cols; col++) {
+                colSums[col] = (Sum)(colSums[col] + added[col] - slot[col]);
+                slot[col] = added[col];
+                dst[col] = (uchar)divisor.Divide(colSums[col]);
+            }
+        }
+
+        typedef void (*BoxColumnFunc)(uint16_t* colSums, uint16_t* slot, const uint16_t* added, uchar* dst, int cols, const ConstantDivisor& divisor);
+
+#ifdef IMAGE_KERNEL_X86
+        IMAGE_KERNEL_TARGET("sse2")
+        inline __m128i BoxColumnStepSse2(uint16_t* colSums, uint16_t* slot, const uint16_t* added, __m128i multiplier, __m128i shift) {
+            __m128i sums = _mm_loadu_si128((const __m128i*)colSums);
+            __m128i in = _mm_loadu_si128((const __m128i*)added);
+            sums = _mm_add_epi16(sums, _mm_sub_epi16(in, _mm_loadu_si128((const __m128i*)slot)));
+            _mm_storeu_si128((__m128i*)colSums, sums);
+            _mm_storeu_si128((__m128i*)slot, in);
+            return _mm_srl_epi16(_mm_mulhi_epu16(sums, multiplier), shift);
+        }
+
+        // 每次處理 16 行 (16 bit 總和)
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void BoxColumnSse2(uint16_t* colSums, uint16_t* slot, const uint16_t* added, uchar* dst, int cols, const ConstantDivisor& divisor) {
+            const __m128i multiplier = _mm_set1_epi16((short)divisor.multiplier);
+            const __m128i shift = _mm_cvtsi32_si128(divisor.shift - 16);
+            int col = 0;
+            for (; col + 16 <= cols; col += 16) {
+                __m128i lo = BoxColumnStepSse2(colSums + col, slot + col, added + col, multiplier, shift);
+                __m128i hi = BoxColumnStepSse2(colSums + col + 8, slot + col + 8, added + col + 8, multiplier, shift);
+                _mm_storeu_si128((__m128i*)(dst + col), _mm_packus_epi16(lo, hi));
+            }
+            BoxColumnScalar(colSums + col, slot + col, added + col, dst + col, cols - col, divisor);
+        }
+
+        IMAGE_KERNEL_TARGET("avx2")
+        inline __m256i BoxColumnStepAvx2(uint16_t* colSums, uint16_t* slot, const uint16_t* added, __m256i multiplier, __m128i shift) {
+            __m256i sums = _mm256_loadu_si256((const __m256i*)colSums);
+            __m256i in = _mm256_loadu_si256((const __m256i*)added);
+            sums = _mm256_add_epi16(sums, _mm256_sub_epi16(in, _mm256_loadu_si256((const __m256i*)slot)));
+            _mm256_storeu_si256((__m256i*)colSums, sums);
+            _mm256_storeu_si256((__m256i*)slot, in);
+            return _mm256_srl_epi16(_mm256_mulhi_epu16(sums, multiplier), shift);
+        }
+
+        // 每次處理 32 行，packus 在 128 bit 內進行，最後重排
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void BoxColumnAvx2(uint16_t* colSums, uint16_t* slot, const uint16_t* added, uchar* dst, int cols, const ConstantDivisor& divisor) {
+            const __m256i multiplier = _mm256_set1_epi16((short)divisor.multiplier);
+            const __m128i shift = _mm_cvtsi32_si128(divisor.shift - 16);
+            int col = 0;
+            for (; col + 32 <= cols; col += 32) {
+                __m256i lo = BoxColumnStepAvx2(colSums + col, slot + col, added + col, multiplier, shift);
+                __m256i hi = BoxColumnStepAvx2(colSums + col + 16, slot + col + 16, added + col + 16, multiplier, shift);
+                _mm256_storeu_si256((__m256i*)(dst + col), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+            }
+            BoxColumnSse2(colSums + col, slot + col, added + col, dst + col, cols - col, divisor);
+        }
+#endif
+
+        inline BoxColumnFunc SelectBoxColumn() {
+            static const BoxColumnFunc func = []() -> BoxColumnFunc {
+#ifdef IMAGE_KERNEL_X86
+                if (simd::CpuSupportsAvx2())
+                    return BoxColumnAvx2;
+                if (simd::CpuSupportsSse2())
+                    return BoxColumnSse2;
+#endif
+                return BoxColumnScalar<uint16_t>;
+            }();
+            return func;
+        }
+    }
+
+    // 由上往下依序處理各列時，保留視窗內 mask 列展開過的列 (只讀第一個通道)，不需建立整張補邊的圖片
+    // 平行處理時每個列區塊各自建立一個，第一次 MoveTo 載入整個視窗
+    // MoveTo(row) 後 Row(x)[radius + col] 為第 row - radius + x 列、第 col 行的像素
+    class BorderedRows
+    {
+    public:
+        BorderedRows(const Mat& image, int mask, BorderMode border = BorderMode::Replicate)
+            : _image(image), _mask(mask), _radius(mask / 2), _stride(image.cols + 2 * (mask / 2)), _border(border) {
+            _rows.resize((size_t)_mask * _stride);
+        }
+
+        // 第 k 列存在第 (k + radius) % mask 個位置，移到下一列時只載入新進入視窗的一列
+        void MoveTo(int row) {
+            if (row == _row + 1 && _row >= 0) {
+                this->Load(row + _radius);
+            }
+            else {
+                for (int k = row - _radius; k <= row + _radius; k++)
+                    this->Load(k);
+            }
+            _row = row;
+        }
+
+        const uchar* Row(int x) const {
+            return &_rows[(size_t)(((_row + x) % _mask + _mask) % _mask) * _stride];
+        }
+
+        int Stride() const { return _stride; }
+
+    private:
+        void Load(int k) {
+            const int slot = ((k + _radius) % _mask + _mask) % _mask;
+            detail::LoadBorderedRow(_image, k, _radius, _border, &_rows[(size_t)slot * _stride]);
+        }
+
+        const Mat& _image;
+        int _mask;
+        int _radius;
+        int _stride;
+        BorderMode _border;
+        int _row = -1;
+        std::vector<uchar> _rows;
+    };
+
+    // 逐列計算的濾波: Row(row, dst) 輸出第 row 列 (單通道)，由上往下依序呼叫時只更新移入、移出視窗的列
+    // 不連續時重新載入整個視窗，平行處理時每個列區塊各自建立一個
+    class RowFilter
+    {
+    public:
+        virtual ~RowFilter() {}
+        virtual void Row(int row, uchar* dst) = 0;
+    };
+
+    // 對 grayImage (只讀第一個通道) 建立 RowFilter
+    typedef std::function<std::unique_ptr<RowFilter>(const Mat& grayImage)> RowFilterFactory;
+
+    // 以列區塊平行做一次濾波，各區塊各自建立 RowFilter，結果與整張一次計算相同
+    inline void FilterGrayRows(const Mat& grayImage, Mat& dst, int mask, int dstChannels, size_t bytesPerRow, const RowFilterFactory& createRowFilter) {
+        CV_Assert(dstChannels == 1 || dstChannels == 3);
+        dst.create(grayImage.size(), dstChannels == 1 ? CV_8UC1 : CV_8UC3);
+        if (grayImage.empty())
+            return;
+
+        const int grain = RowGrain(grayImage.rows, bytesPerRow, 4 * mask);
+        ParallelFor(0, grayImage.rows, grain, [&](int begin, int end) {
+            std::unique_ptr<RowFilter> rowFilter = createRowFilter(grayImage);
+            std::vector<uchar> rowBuffer(dstChannels == 1 ? 0 : grayImage.cols);
+            for (int row = begin; row < end; row++) {
+                uchar* dstRow = dstChannels == 1 ? dst.ptr<uchar>(row) : rowBuffer.data();
+                rowFilter->Row(row, dstRow);
+                detail::StoreGrayRow(dstRow, dst, row, dstChannels);
+            }
+        });
+    }
+
+    // 同一個濾波連續做 times 次，所有次數在同一次由上往下的掃描中完成
+    // 第 k 次落後第 k - 1 次 radius 列，算出一列後馬上被下一次讀取，資料在 cache 中就用完，不必每次都讀寫整張圖片
+    // 多執行緒時分成列區塊，每個區塊上下多算 times * radius 列 (halo，之後每一次少 radius 列)，區塊內不重複計算
+    // 區塊內讀到的列都已算好或在圖片真正的邊界外，結果與逐次處理整張相同
+    // passes 不為 nullptr 時輸出每一次的結果 (第 k 個為做完 k + 1 次，最後一個即為 dst)
+    // stageBytes 為一個 RowFilter 保留的資料量，times 次合計超過 L2 時同時掃描反而互相擠出 cache，改為逐次處理整張
+    // 只做一次時直接以列區塊處理；Wrap 的邊界需要另一側的列，區塊無法獨立計算，也逐次處理
+    inline void FilterGrayTimes(const Mat& grayImage, Mat& dst, int mask, int times, int dstChannels, BorderMode border, size_t bytesPerRow, size_t stageBytes, const RowFilterFactory& createRowFilter, std::vector<Mat>* passes = nullptr) {
+        CV_Assert(times > 0 && (dstChannels == 1 || dstChannels == 3));
+        const int rows = grayImage.rows, cols = grayImage.cols;
+        const int dstType = dstChannels == 1 ? CV_8UC1 : CV_8UC3;
+        dst.create(grayImage.size(), dstType);
+        if (passes != nullptr) {
+            passes->assign(times, Mat());
+            for (int k = 0; k + 1 < times; k++)
+                (*passes)[k].create(grayImage.size(), dstType);
+            passes->back() = dst;
+        }
+        if (grayImage.empty())
+            return;
+
+        if (times == 1 || border == BorderMode::Wrap || (size_t)times * stageBytes > L2_CACHE_BYTES) {
+            Mat current = grayImage;
+            for (int k = 0; k < times; k++) {
+                Mat next;
+                if (k + 1 == times)
+                    next = dst;
+                else if (passes != nullptr)
+                    next = (*passes)[k];
+                FilterGrayRows(current, next, mask, next.empty() ? 1 : next.channels(), bytesPerRow, createRowFilter);
+                current = next;
+            }
+            return;
+        }
+
+        // 每個執行緒約分到 2 個區塊，但至少 4 * halo 列以免重算的比例太高；單執行緒時整張為一個區塊
+        const int radius = mask / 2;
+        const int halo = times * radius;
+        const int threads = ThreadPool::Instance().ThreadCount();
+        const int bandRows = threads > 1 ? std::max((rows + threads * 2 - 1) / (threads * 2), 4 * halo) : rows;
+        const int bandCount = (rows + bandRows - 1) / bandRows;
+        ParallelFor(0, bandCount, 1, [&](int bandBegin, int bandEnd) {
+            std::vector<uchar> rowBuffer(cols);
+            for (int band = bandBegin; band < bandEnd; band++) {
+                const int coreBegin = band * bandRows;
+                const int coreEnd = std::min(rows, coreBegin + bandRows);
+                const int top = std::max(0, coreBegin - halo);
+                const int bottom = std::min(rows, coreEnd + halo);
+
+                // 第 k 次 (0 起算) 讀 stages[k]、寫 stages[k + 1]，中間結果只保留區塊內的列 (單通道)
+                std::vector<Mat> stages(times);
+                std::vector<std::unique_ptr<RowFilter>> rowFilters(times);
+                stages[0] = grayImage.rowRange(top, bottom);
+                for (int k = 1; k < times; k++)
+                    stages[k].create(bottom - top, cols, CV_8UC1);
+                for (int k = 0; k < times; k++)
+                    rowFilters[k] = createRowFilter(stages[k]);
+
+                // 第 k 次要算的範圍 (區塊內的列號): 核心上下 (times - 1 - k) * radius 列
+                auto rangeBegin = [&](int k) { return std::max(0, coreBegin - (times - 1 - k) * radius) - top; };
+                auto rangeEnd = [&](int k) { return std::min(rows, coreEnd + (times - 1 - k) * radius) - top; };
+                const int stepEnd = rangeEnd(times - 1) + (times - 1) * radius;
+                for (int step = rangeBegin(0); step < stepEnd; step++) {
+                    for (int k = 0; k < times; k++) {
+                        const int row = step - k * radius;
+                        if (row < rangeBegin(k) || row >= rangeEnd(k))
+                            continue;
+                        if (k + 1 == times) {
+                            uchar* dstRow = dstChannels == 1 ? dst.ptr<uchar>(top + row) : rowBuffer.data();
+                            rowFilters[k]->Row(row, dstRow);
+                            detail::StoreGrayRow(dstRow, dst, top + row, dstChannels);
+                        }
+                        else {
+                            uchar* stageRow = stages[k + 1].ptr<uchar>(row);
+                            rowFilters[k]->Row(row, stageRow);
+                            if (passes != nullptr && top + row >= coreBegin && top + row < coreEnd)
+                                detail::StoreGrayRow(stageRow, (*passes)[k], top + row, dstChannels);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    namespace detail {
+        // 平均濾波的逐列計算
+        // 第 k 列 (k 可超出範圍) 的水平總和存在 rowSums 的第 (k + radius) % mask 列
+        // 第 row 列的視窗加入第 row + radius 列、移出第 row - 1 - radius 列，兩者使用同一個位置
+        // fixedRowSum 不為 nullptr 時為 mask 固定的水平總和 (16 bit)，取代逐行加減的 BoxRowSum
+        template <typename Sum>
+        class MeanRowFilter : public RowFilter
+        {
+        public:
+            typedef void (*ColumnFunc)(Sum* colSums, Sum* slot, const Sum* added, uchar* dst, int cols, const ConstantDivisor& divisor);
+
+            MeanRowFilter(const Mat& grayImage, int mask, BorderMode border, const ConstantDivisor& divisor, ColumnFunc column, BoxRowSumFunc fixedRowSum)
+                : _image(grayImage), _mask(mask), _radius(mask / 2), _border(border), _divisor(divisor), _column(column), _fixedRowSum(fixedRowSum) {
+                const int cols = grayImage.cols;
+                _padded.resize(cols + 2 * _radius);
+                _rowSums.resize((size_t)mask * cols);
+                _colSums.resize(cols);
+                _added.resize(cols);
+            }
+
+            void Row(int row, uchar* dst) override {
+                const int cols = _image.cols;
+                Sum* slot = &_rowSums[(size_t)((row + _mask - 1) % _mask) * cols];
+                if (row == _row + 1 && _row >= 0) {
+                    this->LoadRow(row + _radius, _added.data());
+                    _column(_colSums.data(), slot, _added.data(), dst, cols, _divisor);
+                }
+                else {
+                    // 重新累計整個視窗
+                    std::fill(_colSums.begin(), _colSums.end(), (Sum)0);
+                    for (int k = row - _radius; k <= row + _radius; k++) {
+                        Sum* sums = &_rowSums[(size_t)((k + _radius) % _mask) * cols];
+                        this->LoadRow(k, sums);
+                        for (int col = 0; col < cols; col++)
+                            _colSums[col] = (Sum)(_colSums[col] + sums[col]);
+                    }
+                    _column(_colSums.data(), slot, slot, dst, cols, _divisor);
+                }
+                _row = row;
+            }
+
+        private:
+            void LoadRow(int k, Sum* sums) {
+                LoadBorderedRow(_image, k, _radius, _border, _padded.data());
+                if constexpr (std::is_same<Sum, uint16_t>::value) {
+                    if (_fixedRowSum != nullptr) {
+                        _fixedRowSum(_padded.data(), _image.cols, sums);
+                        return;
+                    }
+                }
+                BoxRowSum(_padded.data(), _image.cols, _mask, sums);
+            }
+
+            const Mat _image;
+            int _mask;
+            int _radius;
+            BorderMode _border;
+            ConstantDivisor _divisor;
+            ColumnFunc _column;
+            BoxRowSumFunc _fixedRowSum;
+            int _row = -1;
+            std::vector<uchar> _padded;
+            std::vector<Sum> _rowSums, _colSums, _added;
+        };
+
+        // 平均濾波的 RowFilter (MeanFilterGray 與 MeanFilterGrayTimes 共用)
+        inline RowFilterFactory MeanRowFilterOf(int mask, BorderMode border) {
+            const uint32_t area = (uint32_t)mask * mask;
+            const uint32_t maxSum = 255 * area;
+            const ConstantDivisor divisor16(area, maxSum, 16);
+            const ConstantDivisor divisor(area, maxSum);
+            const bool useUint16 = maxSum <= 0xFFFF && divisor16.FitsUint16();
+            const BoxColumnFunc column16 = SelectBoxColumn();
+            // 常用的 3x3、5x5、7x7 水平總和使用 mask 固定 (完全展開) 的版本
+            const BoxRowSumFunc fixedRowSum = mask == 3 ? SelectFixedBoxRowSum<3>()
+                : mask == 5 ? SelectFixedBoxRowSum<5>()
+                : mask == 7 ? SelectFixedBoxRowSum<7>()
+                : nullptr;
+            return [=](const Mat& grayImage) -> std::unique_ptr<RowFilter> {
+                if (useUint16)
+                    return std::unique_ptr<RowFilter>(new MeanRowFilter<uint16_t>(grayImage, mask, border, divisor16, column16, fixedRowSum));
+                return std::unique_ptr<RowFilter>(new MeanRowFilter<int>(grayImage, mask, border, divisor, BoxColumnScalar<int>, nullptr));
+            };
+        }
+
+        inline size_t MeanFilterBytesPerRow(const Mat& grayImage, int dstChannels) {
+            return (size_t)grayImage.cols * (grayImage.channels() + dstChannels + 2 * sizeof(int));
+        }
+
+        // MeanRowFilter 保留的資料量: mask 列水平總和、垂直總和與展開的一列
+        inline size_t MeanFilterStageBytes(const Mat& grayImage, int mask) {
+            return (size_t)grayImage.cols * ((mask + 2) * sizeof(int) + 1);
+        }
+    }
+
+    // 平均濾波 (mask x mask，邊界依 border 取值)，結果為總和除以 mask^2 無條件捨去
+    // 每列先求水平視窗總和，各行再累計垂直總和 (加入新列、減去移出的列)，每個像素的計算量與 mask 無關
+    // 只讀取第一個通道，dstChannels = 3 輸出三通道相同的 CV_8UC3
+    inline void MeanFilterGray(const Mat& grayImage, Mat& dst, int mask, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1) && (dstChannels == 1 || dstChannels == 3));
+        // 以列區塊平行處理
+        FilterGrayRows(grayImage, dst, mask, dstChannels, detail::MeanFilterBytesPerRow(grayImage, dstChannels), detail::MeanRowFilterOf(mask, border));
+    }
+
+    inline Mat MeanFilterGray(const Mat& grayImage, int mask, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        Mat dst;
+        MeanFilterGray(grayImage, dst, mask, dstChannels, border);
+        return dst;
+    }
+
+    // 連續做 times 次平均濾波，所有次數在同一次掃描中完成 (見 FilterGrayTimes)，結果與逐次呼叫 MeanFilterGray 相同
+    inline void MeanFilterGrayTimes(const Mat& grayImage, Mat& dst, int mask, int times, int dstChannels = 1, BorderMode border = BorderMode::Replicate, std::vector<Mat>* passes = nullptr) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1));
+        FilterGrayTimes(grayImage, dst, mask, times, dstChannels, border, detail::MeanFilterBytesPerRow(grayImage, dstChannels), detail::MeanFilterStageBytes(grayImage, mask), detail::MeanRowFilterOf(mask, border), passes);
+    }
+}
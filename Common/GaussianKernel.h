@@ -0,0 +1,348 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "FilterKernel.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    // 未給出 sigma 時由 kernel 大小推算 (與 OpenCV getGaussianKernel 相同)
+    inline double GaussianSigmaOf(int kernelSize) {
+        return 0.3 * ((kernelSize - 1.0) * 0.5 - 1.0) + 0.8;
+    }
+
+    namespace detail {
+        // 水平、垂直權重總和皆為 2^12，兩次相乘後最大 255 * 2^24 仍在 32 bit 內，最後右移 24 bit
+        const int GAUSSIAN_ROW_SHIFT = 12;
+        const int GAUSSIAN_COLUMN_SHIFT = 12;
+
+        // 二維 Gaussian 為兩個一維 Gaussian 的乘積，正規化後也可分開
+        struct GaussianWeights
+        {
+            std::vector<uint32_t> row;
+            std::vector<uint32_t> column;
+        };
+
+        // 一維權重四捨五入成整數，誤差補在中心使總和剛好為 one
+        template <typename Weight>
+        inline std::vector<Weight> QuantizeWeights(const std::vector<double>& weights, int one) {
+            std::vector<Weight> quantized(weights.size());
+            int64_t sum = 0;
+            for (size_t i = 0; i < weights.size(); i++) {
+                quantized[i] = (Weight)std::lround(weights[i] * one);
+                sum += quantized[i];
+            }
+            quantized[weights.size() / 2] = (Weight)(quantized[weights.size() / 2] + (one - sum));
+            return quantized;
+        }
+
+        inline GaussianWeights CreateGaussianWeights(int kernelSize, double sigma) {
+            const int CENTER = kernelSize / 2;
+            std::vector<double> weights(kernelSize);
+            double sum = 0.0;
+            for (int i = 0; i < kernelSize; i++) {
+                const double x = double(i) - double(CENTER);
+                weights[i] = std::exp(-(x * x) / (2.0 * sigma * sigma));
+                sum += weights[i];
+            }
+            for (double& weight : weights)
+                weight /= sum;
+
+            GaussianWeights result;
+            result.row = QuantizeWeights<uint32_t>(weights, 1 << GAUSSIAN_ROW_SHIFT);
+            result.column = QuantizeWeights<uint32_t>(weights, 1 << GAUSSIAN_COLUMN_SHIFT);
+            return result;
+        }
+
+        // 以 (size, sigma) 快取產生過的權重，重複濾波時不必重新計算
+        inline std::shared_ptr<const GaussianWeights> GaussianWeightsOf(int kernelSize, double sigma) {
+            static std::mutex cacheMutex;
+            static std::map<std::pair<int, double>, std::shared_ptr<const GaussianWeights>> cache;
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            std::shared_ptr<const GaussianWeights>& weights = cache[std::make_pair(kernelSize, sigma)];
+            if (!weights)
+                weights = std::make_shared<const GaussianWeights>(CreateGaussianWeights(kernelSize, sigma));
+            return weights;
+        }
+
+        // 展開過的一列做水平加權
+        inline void GaussianRow(const uchar* padded, const uint32_t* weights, int mask, uint32_t* dst, int cols) {
+            std::fill(dst, dst + cols, 0);
+            for (int k = 0; k < mask; k++) {
+                const uint32_t weight = weights[k];
+                const uchar* src = padded + k;
+                for (int col = 0; col < cols; col++)
+                    dst[col] += src[col] * weight;
+            }
+        }
+
+        // 水平加權結果保留 mask 列，第 k 列存在第 (k + radius) % mask 個位置，垂直加權後無條件捨去
+        // 接續上一列時只需水平加權新進入視窗的一列，否則重新計算視窗內的 mask 列
+        class GaussianRowFilter : public RowFilter
+        {
+        public:
+            GaussianRowFilter(const Mat& grayImage, int mask, BorderMode border, std::shared_ptr<const GaussianWeights> weights)
+                : _image(grayImage), _mask(mask), _radius(mask / 2), _border(border), _weights(std::move(weights)),
+                _padded(grayImage.cols + 2 * (mask / 2)), _rowSums((size_t)mask * grayImage.cols), _sums(grayImage.cols) {
+            }
+
+            void Row(int row, uchar* dst) override {
+                const int cols = _image.cols, mask = _mask;
+                const int SHIFT = GAUSSIAN_ROW_SHIFT + GAUSSIAN_COLUMN_SHIFT;
+                if (row == _row + 1 && _row >= 0)
+                    this->LoadRow(row + _radius);
+                else
+                    for (int k = row - _radius; k <= row + _radius; k++)
+                        this->LoadRow(k);
+                _row = row;
+
+                std::fill(_sums.begin(), _sums.end(), 0u);
+                for (int x = 0; x < mask; x++) {
+                    const uint32_t weight = _weights->column[x];
+                    const uint32_t* src = &_rowSums[(size_t)((row + x) % mask) * cols];
+                    for (int col = 0; col < cols; col++)
+                        _sums[col] += src[col] * weight;
+                }
+                for (int col = 0; col < cols; col++)
+                    dst[col] = (uchar)(_sums[col] >> SHIFT);
+            }
+
+        private:
+            // 第 k 列 (可超出範圍) 水平加權後存入對應的位置
+            void LoadRow(int k) {
+                const int cols = _image.cols;
+                LoadBorderedRow(_image, k, _radius, _border, _padded.data());
+                GaussianRow(_padded.data(), _weights->row.data(), _mask, &_rowSums[(size_t)((k + _radius) % _mask) * cols], cols);
+            }
+
+            const Mat _image;
+            int _mask;
+            int _radius;
+            BorderMode _border;
+            std::shared_ptr<const GaussianWeights> _weights;
+            int _row = -1;
+            std::vector<uchar> _padded;
+            std::vector<uint32_t> _rowSums, _sums;
+        };
+
+        // Young–van Vliet 三階遞迴 Gaussian 的係數
+        // 正向 w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]，反向以相同係數由後往前
+        struct RecursiveGaussianCoefficients
+        {
+            float b;
+            float a[3];
+            // 右邊界 (之後的輸入皆等於最後一個像素) 的反向初始值: y[N-1+k] = u + dot(boundary[k], w[N-1..N-3] - u)
+            float boundary[3][3];
+        };
+
+        typedef double Matrix3[3][3];
+
+        inline void Multiply3(const Matrix3 x, const Matrix3 y, Matrix3 result) {
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    result[i][j] = x[i][0] * y[0][j] + x[i][1] * y[1][j] + x[i][2] * y[2][j];
+        }
+
+        // 以餘因子求反矩陣
+        inline void Invert3(const Matrix3 m, Matrix3 result) {
+            const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++) {
+                    const int r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+                    result[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+                }
+        }
+
+        inline RecursiveGaussianCoefficients CreateRecursiveGaussian(double sigma) {
+            const double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+            const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+            const double a[3] = {
+                (2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q) / b0,
+                -(1.4281 * q * q + 1.26661 * q * q * q) / b0,
+                (0.422205 * q * q * q) / b0,
+            };
+            const double b = 1.0 - (a[0] + a[1] + a[2]);
+
+            // 超出右邊界後正向結果與 u 的差 d 以 A = [a1 a2 a3; 1 0 0; 0 1 0] 遞推
+            // 反向結果的差為 g^T d，g 滿足 g^T (I - a1 A - a2 A^2 - a3 A^3) = b e1^T (Triggs–Sdika)
+            const Matrix3 A = { { a[0], a[1], a[2] }, { 1, 0, 0 }, { 0, 1, 0 } };
+            Matrix3 A2, A3, M, inverse;
+            Multiply3(A, A, A2);
+            Multiply3(A2, A, A3);
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    M[i][j] = (i == j ? 1.0 : 0.0) - a[0] * A[i][j] - a[1] * A2[i][j] - a[2] * A3[i][j];
+            Invert3(M, inverse);
+
+            RecursiveGaussianCoefficients coefficients;
+            coefficients.b = (float)b;
+            for (int i = 0; i < 3; i++)
+                coefficients.a[i] = (float)a[i];
+            // boundary[k] = g^T A^k
+            double g[3] = { b * inverse[0][0], b * inverse[0][1], b * inverse[0][2] };
+            for (int k = 0; k < 3; k++) {
+                for (int i = 0; i < 3; i++)
+                    coefficients.boundary[k][i] = (float)g[i];
+                const double next[3] = {
+                    g[0] * A[0][0] + g[1] * A[1][0] + g[2] * A[2][0],
+                    g[0] * A[0][1] + g[1] * A[1][1] + g[2] * A[2][1],
+                    g[0] * A[0][2] + g[1] * A[1][2] + g[2] * A[2][2],
+                };
+                std::copy(next, next + 3, g);
+            }
+            return coefficients;
+        }
+
+        // 一個方向的遞迴濾波，data[n * step + i] (i = 0 ~ width - 1) 為第 n 個位置，width 個序列同時處理
+        // 邊界只支援 Replicate 與 Zero，scratch 至少 5 * width 個 float
+        inline void RecursiveGaussianLines(float* data, int length, size_t step, int width, const RecursiveGaussianCoefficients& c, BorderMode border, float* scratch) {
+            const bool zeroBorder = border == BorderMode::Zero;
+            auto at = [data, step](int n) { return data + (size_t)n * step; };
+            float* u = scratch;                 // 右邊界之後的輸入 (最後一個輸入或 0)
+            float* tail = scratch + width;      // 反向結果在位置 length - 1 + k 的值
+            float* zeros = scratch + 4 * width;
+            std::fill(zeros, zeros + width, 0.0f);
+            if (zeroBorder)
+                std::fill(u, u + width, 0.0f);
+            else
+                std::copy(at(length - 1), at(length - 1) + width, u);
+
+            // 正向，左邊界之前的正向結果: Zero 時為 0；Replicate 時輸入等於第一個位置，穩態 w = x，因此 w[0] = x[0] 且 w[-k] = w[0]
+            auto forward = [&](int n) -> const float* {
+                return n >= 0 ? at(n) : (zeroBorder ? zeros : at(0));
+            };
+            for (int n = zeroBorder ? 0 : 1; n < length; n++) {
+                float* line = at(n);
+                const float* w1 = forward(n - 1);
+                const float* w2 = forward(n - 2);
+                const float* w3 = forward(n - 3);
+                for (int i = 0; i < width; i++)
+                    line[i] = c.b * line[i] + c.a[0] * w1[i] + c.a[1] * w2[i] + c.a[2] * w3[i];
+            }
+
+            // 反向，右邊界以 Triggs–Sdika 初始值計算
+            const float* d0 = forward(length - 1);
+            const float* d1 = forward(length - 2);
+            const float* d2 = forward(length - 3);
+            for (int k = 0; k < 3; k++)
+                for (int i = 0; i < width; i++)
+                    tail[(size_t)k * width + i] = u[i] + c.boundary[k][0] * (d0[i] - u[i]) + c.boundary[k][1] * (d1[i] - u[i]) + c.boundary[k][2] * (d2[i] - u[i]);
+            std::copy(tail, tail + width, at(length - 1));
+
+            auto backward = [&](int n) -> const float* {
+                return n < length ? at(n) : tail + (size_t)(n - (length - 1)) * width;
+            };
+            for (int n = length - 2; n >= 0; n--) {
+                float* line = at(n);
+                const float* y1 = backward(n + 1);
+                const float* y2 = backward(n + 2);
+                const float* y3 = backward(n + 3);
+                for (int i = 0; i < width; i++)
+                    line[i] = c.b * line[i] + c.a[0] * y1[i] + c.a[1] * y2[i] + c.a[2] * y3[i];
+            }
+        }
+    }
+
+    namespace detail {
+        // Gaussian 濾波的 RowFilter (GaussianFilterGray 與 GaussianFilterGrayTimes 共用)
+        inline RowFilterFactory GaussianRowFilterOf(int mask, double sigma, BorderMode border) {
+            std::shared_ptr<const GaussianWeights> weights = GaussianWeightsOf(mask, sigma > 0 ? sigma : GaussianSigmaOf(mask));
+            return [mask, border, weights](const Mat& grayImage) -> std::unique_ptr<RowFilter> {
+                return std::unique_ptr<RowFilter>(new GaussianRowFilter(grayImage, mask, border, weights));
+            };
+        }
+
+        inline size_t GaussianFilterBytesPerRow(const Mat& grayImage, int mask, int dstChannels) {
+            return (size_t)grayImage.cols * (grayImage.channels() + dstChannels + mask * sizeof(uint32_t));
+        }
+
+        // GaussianRowFilter 保留的資料量: mask 列水平加權結果、垂直加權的總和與展開的一列
+        inline size_t GaussianFilterStageBytes(const Mat& grayImage, int mask) {
+            return (size_t)grayImage.cols * ((mask + 1) * sizeof(uint32_t) + 1);
+        }
+    }
+
+    // Gaussian 濾波 (mask x mask，邊界依 border 取值)，sigma <= 0 時由 mask 推算
+    // 先水平再垂直兩次一維加權，權重為總和 2^12 的定點整數並依 (mask, sigma) 快取
+    // 結果無條件捨去，與二維 double 加權後轉 uchar 相同，連續多次濾波時不會逐次偏亮
+    // 只讀取第一個通道，dstChannels = 3 輸出三通道相同的 CV_8UC3
+    inline void GaussianFilterGray(const Mat& grayImage, Mat& dst, int mask, int dstChannels = 1, double sigma = -1, BorderMode border = BorderMode::Replicate) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1) && (dstChannels == 1 || dstChannels == 3));
+        // 以列區塊平行處理
+        FilterGrayRows(grayImage, dst, mask, dstChannels, detail::GaussianFilterBytesPerRow(grayImage, mask, dstChannels), detail::GaussianRowFilterOf(mask, sigma, border));
+    }
+
+    inline Mat GaussianFilterGray(const Mat& grayImage, int mask, int dstChannels = 1, double sigma = -1, BorderMode border = BorderMode::Replicate) {
+        Mat dst;
+        GaussianFilterGray(grayImage, dst, mask, dstChannels, sigma, border);
+        return dst;
+    }
+
+    // 連續做 times 次 Gaussian 濾波，所有次數在同一次掃描中完成 (見 FilterGrayTimes)，結果與逐次呼叫 GaussianFilterGray 相同
+    inline void GaussianFilterGrayTimes(const Mat& grayImage, Mat& dst, int mask, int times, int dstChannels = 1, double sigma = -1, BorderMode border = BorderMode::Replicate, std::vector<Mat>* passes = nullptr) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1));
+        FilterGrayTimes(grayImage, dst, mask, times, dstChannels, border, detail::GaussianFilterBytesPerRow(grayImage, mask, dstChannels), detail::GaussianFilterStageBytes(grayImage, mask), detail::GaussianRowFilterOf(mask, sigma, border), passes);
+    }
+
+    // 遞迴 (IIR) Gaussian，每個像素固定做水平、垂直各一次正反向三階遞迴，計算量與 sigma 無關，適合大範圍模糊
+    // 為近似結果 (sigma 越小誤差越大，小 sigma 建議用 GaussianFilterGray)，影響範圍不會被 mask 截斷；sigma 需至少 0.5
+    // 邊界只支援 Replicate 與 Zero
+    inline void RecursiveGaussianGray(const Mat& grayImage, Mat& dst, double sigma, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        CV_Assert(grayImage.depth() == CV_8U && sigma >= 0.5 && (dstChannels == 1 || dstChannels == 3));
+        CV_Assert(border == BorderMode::Replicate || border == BorderMode::Zero);
+        dst.create(grayImage.size(), dstChannels == 1 ? CV_8UC1 : CV_8UC3);
+        if (grayImage.empty())
+            return;
+
+        const int rows = grayImage.rows, cols = grayImage.cols;
+        const int channels = grayImage.channels();
+        const detail::RecursiveGaussianCoefficients coefficients = detail::CreateRecursiveGaussian(sigma);
+
+        std::vector<float> data((size_t)rows * cols);
+        const int rowGrain = RowGrain(rows, (size_t)cols * (channels + sizeof(float)));
+
+        // 水平: 每列一個序列，以列區塊平行處理
+        ParallelFor(0, rows, rowGrain, [&](int begin, int end) {
+            float scratch[5];
+            for (int row = begin; row < end; row++) {
+                const uchar* src = grayImage.ptr<uchar>(row);
+                float* line = &data[(size_t)row * cols];
+                for (int col = 0; col < cols; col++)
+                    line[col] = src[col * channels];
+                detail::RecursiveGaussianLines(line, cols, 1, 1, coefficients, border, scratch);
+            }
+        });
+
+        // 垂直: 一個行區塊的各列一起處理，依序存取記憶體，以行區塊平行處理 (至少 64 行)
+        const int columnGrain = std::max(64, (cols + ThreadPool::Instance().ThreadCount() * 4 - 1) / (ThreadPool::Instance().ThreadCount() * 4));
+        ParallelFor(0, cols, columnGrain, [&](int begin, int end) {
+            std::vector<float> scratch(5 * (size_t)(end - begin));
+            detail::RecursiveGaussianLines(data.data() + begin, rows, cols, end - begin, coefficients, border, scratch.data());
+        });
+
+        ParallelFor(0, rows, rowGrain, [&](int begin, int end) {
+            std::vector<uchar> rowBuffer(cols);
+            for (int row = begin; row < end; row++) {
+                const float* line = &data[(size_t)row * cols];
+                for (int col = 0; col < cols; col++)
+                    rowBuffer[col] = saturate_cast<uchar>(line[col]);
+                detail::StoreGrayRow(rowBuffer.data(), dst, row, dstChannels);
+            }
+        });
+    }
+
+    inline Mat RecursiveGaussianGray(const Mat& grayImage, double sigma, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        Mat dst;
+        RecursiveGaussianGray(grayImage, dst, sigma, dstChannels, border);
+        return dst;
+    }
+}
@@ -0,0 +1,191 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    // 灰階權重 (百分比，依 B, G, R 排列)
+    enum class GrayWeights
+    {
+        Luma,       // 0.3 R + 0.59 G + 0.11 B
+        Balanced,   // 0.34 R + 0.33 G + 0.33 B
+    };
+
+    namespace detail {
+        // 一列 BGR 轉灰階，weights 為 B, G, R 的百分比權重
+        typedef void (*GrayRowFunc)(const uchar* bgr, uchar* gray, int width, const int* weights);
+
+        inline void WeightsOf(GrayWeights grayWeights, int* weights) {
+            const int LUMA[3] = { 11, 59, 30 };
+            const int BALANCED[3] = { 33, 33, 34 };
+            const int* source = grayWeights == GrayWeights::Luma ? LUMA : BALANCED;
+            for (int c = 0; c < 3; c++)
+                weights[c] = source[c];
+        }
+
+        // 定點數: (wB * B + wG * G + wR * R) / 100，總和最大 25500 可用 16 bit 運算
+        // x / 100 == (x * 41944) >> 22 對 0 ~ 25500 皆成立
+        inline int DivideBy100(int sum) {
+            return (sum * 41944) >> 22;
+        }
+
+        inline void GrayRowScalar(const uchar* bgr, uchar* gray, int width, const int* weights) {
+            for (int x = 0; x < width; x++, bgr += 3)
+                gray[x] = (uchar)DivideBy100(weights[0] * bgr[0] + weights[1] * bgr[1] + weights[2] * bgr[2]);
+        }
+
+#ifdef IMAGE_KERNEL_X86
+        IMAGE_KERNEL_TARGET("sse2")
+        inline __m128i GraySse2(__m128i b, __m128i g, __m128i r, __m128i wb, __m128i wg, __m128i wr) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i divisor = _mm_set1_epi16((short)41944);
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wb),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), wg)),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), wr));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), wg)),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), wr));
+            lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, divisor), 6);
+            hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, divisor), 6);
+            return _mm_packus_epi16(lo, hi);
+        }
+
+        // 32 個 BGR 像素轉灰階，gray0 為前 16 個、gray1 為後 16 個
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void Gray32Sse2(const uchar* bgr, __m128i wb, __m128i wg, __m128i wr, __m128i& gray0, __m128i& gray1) {
+            __m128i v[6];
+            for (int i = 0; i < 6; i++)
+                v[i] = _mm_loadu_si128((const __m128i*)(bgr + i * 16));
+            simd::DeinterleaveBgrSse2(v);
+            gray0 = GraySse2(v[0], v[2], v[4], wb, wg, wr);
+            gray1 = GraySse2(v[1], v[3], v[5], wb, wg, wr);
+        }
+
+        // 每次處理 32 個像素
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void GrayRowSse2(const uchar* bgr, uchar* gray, int width, const int* weights) {
+            const __m128i wb = _mm_set1_epi16((short)weights[0]);
+            const __m128i wg = _mm_set1_epi16((short)weights[1]);
+            const __m128i wr = _mm_set1_epi16((short)weights[2]);
+            int x = 0;
+            for (; x + 32 <= width; x += 32) {
+                __m128i gray0, gray1;
+                Gray32Sse2(bgr + x * 3, wb, wg, wr, gray0, gray1);
+                _mm_storeu_si128((__m128i*)(gray + x), gray0);
+                _mm_storeu_si128((__m128i*)(gray + x + 16), gray1);
+            }
+            GrayRowScalar(bgr + x * 3, gray + x, width - x, weights);
+        }
+
+        IMAGE_KERNEL_TARGET("avx2")
+        inline __m256i GrayAvx2(__m256i b, __m256i g, __m256i r, __m256i wb, __m256i wg, __m256i wr) {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i divisor = _mm256_set1_epi16((short)41944);
+            __m256i lo = _mm256_add_epi16(_mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), wb),
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(g, zero), wg)),
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(r, zero), wr));
+            __m256i hi = _mm256_add_epi16(_mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), wb),
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(g, zero), wg)),
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(r, zero), wr));
+            lo = _mm256_srli_epi16(_mm256_mulhi_epu16(lo, divisor), 6);
+            hi = _mm256_srli_epi16(_mm256_mulhi_epu16(hi, divisor), 6);
+            return _mm256_packus_epi16(lo, hi);
+        }
+
+        // 64 個 BGR 像素轉灰階，gray0 為前 32 個、gray1 為後 32 個
+        // 低 128 bit 載入第 0 ~ 31 個像素、高 128 bit 載入第 32 ~ 63 個像素，unpack 只在 128 bit 內進行，最後再重排
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void Gray64Avx2(const uchar* bgr, __m256i wb, __m256i wg, __m256i wr, __m256i& gray0, __m256i& gray1) {
+            __m256i v[6];
+            for (int i = 0; i < 6; i++)
+                v[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*)(bgr + i * 16))),
+                    _mm_loadu_si128((const __m128i*)(bgr + 96 + i * 16)), 1);
+            for (int layer = 0; layer < 5; layer++) {
+                __m256i t0 = _mm256_unpacklo_epi8(v[0], v[3]);
+                __m256i t1 = _mm256_unpackhi_epi8(v[0], v[3]);
+                __m256i t2 = _mm256_unpacklo_epi8(v[1], v[4]);
+                __m256i t3 = _mm256_unpackhi_epi8(v[1], v[4]);
+                __m256i t4 = _mm256_unpacklo_epi8(v[2], v[5]);
+                __m256i t5 = _mm256_unpackhi_epi8(v[2], v[5]);
+                v[0] = t0; v[1] = t1; v[2] = t2; v[3] = t3; v[4] = t4; v[5] = t5;
+            }
+            __m256i g0 = GrayAvx2(v[0], v[2], v[4], wb, wg, wr);
+            __m256i g1 = GrayAvx2(v[1], v[3], v[5], wb, wg, wr);
+            gray0 = _mm256_permute2x128_si256(g0, g1, 0x20);
+            gray1 = _mm256_permute2x128_si256(g0, g1, 0x31);
+        }
+
+        // 每次處理 64 個像素
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void GrayRowAvx2(const uchar* bgr, uchar* gray, int width, const int* weights) {
+            const __m256i wb = _mm256_set1_epi16((short)weights[0]);
+            const __m256i wg = _mm256_set1_epi16((short)weights[1]);
+            const __m256i wr = _mm256_set1_epi16((short)weights[2]);
+            int x = 0;
+            for (; x + 64 <= width; x += 64) {
+                __m256i gray0, gray1;
+                Gray64Avx2(bgr + x * 3, wb, wg, wr, gray0, gray1);
+                _mm256_storeu_si256((__m256i*)(gray + x), gray0);
+                _mm256_storeu_si256((__m256i*)(gray + x + 32), gray1);
+            }
+            GrayRowSse2(bgr + x * 3, gray + x, width - x, weights);
+        }
+#endif
+
+        // 依 CPU 選擇實作，只判斷一次
+        inline GrayRowFunc SelectGrayRow() {
+            static const GrayRowFunc func = []() -> GrayRowFunc {
+#ifdef IMAGE_KERNEL_X86
+                if (simd::CpuSupportsAvx2())
+                    return GrayRowAvx2;
+                if (simd::CpuSupportsSse2())
+                    return GrayRowSse2;
+#endif
+                return GrayRowScalar;
+            }();
+            return func;
+        }
+    }
+
+    // BGR 轉灰階 (定點數運算，結果為加權和無條件捨去)
+    // dstChannels = 1 輸出 CV_8UC1，dstChannels = 3 輸出三通道相同的 CV_8UC3
+    inline void ConvertBgrToGray(const Mat& colorImage, Mat& grayImage, GrayWeights grayWeights = GrayWeights::Luma, int dstChannels = 1) {
+        CV_Assert(colorImage.type() == CV_8UC3 && (dstChannels == 1 || dstChannels == 3));
+        grayImage.create(colorImage.size(), dstChannels == 1 ? CV_8UC1 : CV_8UC3);
+
+        int weights[3];
+        detail::WeightsOf(grayWeights, weights);
+        detail::GrayRowFunc grayRow = detail::SelectGrayRow();
+
+        // 以列區塊平行處理
+        const int grain = RowGrain(colorImage.rows, (size_t)colorImage.cols * (3 + dstChannels));
+        ParallelFor(0, colorImage.rows, grain, [&](int begin, int end) {
+            std::vector<uchar> rowBuffer(dstChannels == 1 ? 0 : colorImage.cols);
+            for (int row = begin; row < end; row++) {
+                const uchar* colorRow = colorImage.ptr<uchar>(row);
+                if (dstChannels == 1) {
+                    grayRow(colorRow, grayImage.ptr<uchar>(row), colorImage.cols, weights);
+                }
+                else {
+                    grayRow(colorRow, rowBuffer.data(), colorImage.cols, weights);
+                    uchar* grayRow3 = grayImage.ptr<uchar>(row);
+                    for (int col = 0; col < colorImage.cols; col++, grayRow3 += 3)
+                        grayRow3[0] = grayRow3[1] = grayRow3[2] = rowBuffer[col];
+                }
+            }
+        });
+    }
+
+    inline Mat ConvertBgrToGray(const Mat& colorImage, GrayWeights grayWeights = GrayWeights::Luma, int dstChannels = 1) {
+        Mat grayImage;
+        ConvertBgrToGray(colorImage, grayImage, grayWeights, dstChannels);
+        return grayImage;
+    }
+}
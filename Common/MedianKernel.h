@@ -0,0 +1,358 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "Simd.h"
+#include "FilterKernel.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    namespace detail {
+        // 比較器: 較小值放到 lo、較大值放到 hi
+        struct Comparator
+        {
+            uchar lo;
+            uchar hi;
+        };
+
+        // 取中位數的比較網路，執行後 output 位置為中位數
+        struct MedianNetwork
+        {
+            std::vector<Comparator> comparators;
+            int output = 0;
+        };
+
+        // 以 Batcher odd-even merge sort 排序補齊到 2 的次方個輸入 (補上的輸入視為 255，不需實際比較)
+        // 再由輸出往回只保留會影響中間位置的比較器，3x3 為 24 個、5x5 為 113 個比較器
+        inline MedianNetwork BuildMedianNetwork(int count) {
+            int size = 1;
+            while (size < count)
+                size *= 2;
+            const int CONSTANT = -1;
+            std::vector<int> slots(size);
+            for (int i = 0; i < size; i++)
+                slots[i] = i < count ? i : CONSTANT;
+
+            std::vector<Comparator> comparators;
+            for (int p = 1; p < size; p *= 2) {
+                for (int k = p; k >= 1; k /= 2) {
+                    for (int j = k % p; j + k < size; j += 2 * k) {
+                        for (int i = 0; i < std::min(k, size - j - k); i++) {
+                            const int a = i + j, b = i + j + k;
+                            if ((a / (2 * p)) != (b / (2 * p)))
+                                continue;
+                            if (slots[b] == CONSTANT)
+                                continue;
+                            if (slots[a] == CONSTANT) {
+                                std::swap(slots[a], slots[b]);
+                                continue;
+                            }
+                            comparators.push_back({ (uchar)slots[a], (uchar)slots[b] });
+                        }
+                    }
+                }
+            }
+
+            MedianNetwork network;
+            network.output = slots[count / 2];
+            std::vector<bool> needed(count, false);
+            needed[network.output] = true;
+            for (int c = (int)comparators.size() - 1; c >= 0; c--) {
+                const Comparator& comparator = comparators[c];
+                if (!needed[comparator.lo] && !needed[comparator.hi])
+                    continue;
+                needed[comparator.lo] = needed[comparator.hi] = true;
+                network.comparators.push_back(comparator);
+            }
+            std::reverse(network.comparators.begin(), network.comparators.end());
+            return network;
+        }
+
+        // 3x3、5x5 的比較網路，只建立一次
+        inline const MedianNetwork& MedianNetworkOf(int mask) {
+            static const MedianNetwork NETWORK3 = BuildMedianNetwork(9);
+            static const MedianNetwork NETWORK5 = BuildMedianNetwork(25);
+            CV_Assert(mask == 3 || mask == 5);
+            return mask == 3 ? NETWORK3 : NETWORK5;
+        }
+
+        // rows: mask 列展開過的列 (BorderedRows)，dst[col] 為以 col 為中心的視窗中位數
+        typedef void (*MedianNetworkRowFunc)(const uchar* const* rows, int mask, uchar* dst, int cols, const MedianNetwork& network);
+
+        inline void MedianNetworkRowScalar(const uchar* const* rows, int mask, uchar* dst, int cols, const MedianNetwork& network) {
+            uchar v[25];
+            for (int col = 0; col < cols; col++) {
+                for (int x = 0; x < mask; x++)
+                    for (int y = 0; y < mask; y++)
+                        v[x * mask + y] = rows[x][col + y];
+                for (const Comparator& comparator : network.comparators) {
+                    const uchar a = v[comparator.lo], b = v[comparator.hi];
+                    v[comparator.lo] = std::min(a, b);
+                    v[comparator.hi] = std::max(a, b);
+                }
+                dst[col] = v[network.output];
+            }
+        }
+
+#ifdef IMAGE_KERNEL_X86
+        // 每次處理 16 個相鄰像素，各像素的視窗在各自的 byte 上同時比較
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void MedianNetworkRowSse2(const uchar* const* rows, int mask, uchar* dst, int cols, const MedianNetwork& network) {
+            __m128i v[25];
+            int col = 0;
+            for (; col + 16 <= cols; col += 16) {
+                for (int x = 0; x < mask; x++)
+                    for (int y = 0; y < mask; y++)
+                        v[x * mask + y] = _mm_loadu_si128((const __m128i*)(rows[x] + col + y));
+                for (const Comparator& comparator : network.comparators) {
+                    const __m128i a = v[comparator.lo], b = v[comparator.hi];
+                    v[comparator.lo] = _mm_min_epu8(a, b);
+                    v[comparator.hi] = _mm_max_epu8(a, b);
+                }
+                _mm_storeu_si128((__m128i*)(dst + col), v[network.output]);
+            }
+            const uchar* tailRows[5];
+            for (int x = 0; x < mask; x++)
+                tailRows[x] = rows[x] + col;
+            MedianNetworkRowScalar(tailRows, mask, dst + col, cols - col, network);
+        }
+
+        // 每次處理 32 個相鄰像素
+        IMAGE_KERNEL_TARGET("avx2")
+        inline void MedianNetworkRowAvx2(const uchar* const* rows, int mask, uchar* dst, int cols, const MedianNetwork& network) {
+            __m256i v[25];
+            int col = 0;
+            for (; col + 32 <= cols; col += 32) {
+                for (int x = 0; x < mask; x++)
+                    for (int y = 0; y < mask; y++)
+                        v[x * mask + y] = _mm256_loadu_si256((const __m256i*)(rows[x] + col + y));
+                for (const Comparator& comparator : network.comparators) {
+                    const __m256i a = v[comparator.lo], b = v[comparator.hi];
+                    v[comparator.lo] = _mm256_min_epu8(a, b);
+                    v[comparator.hi] = _mm256_max_epu8(a, b);
+                }
+                _mm256_storeu_si256((__m256i*)(dst + col), v[network.output]);
+            }
+            const uchar* tailRows[5];
+            for (int x = 0; x < mask; x++)
+                tailRows[x] = rows[x] + col;
+            MedianNetworkRowSse2(tailRows, mask, dst + col, cols - col, network);
+        }
+#endif
+
+        inline MedianNetworkRowFunc SelectMedianNetworkRow() {
+            static const MedianNetworkRowFunc func = []() -> MedianNetworkRowFunc {
+#ifdef IMAGE_KERNEL_X86
+                if (simd::CpuSupportsAvx2())
+                    return MedianNetworkRowAvx2;
+                if (simd::CpuSupportsSse2())
+                    return MedianNetworkRowSse2;
+#endif
+                return MedianNetworkRowScalar;
+            }();
+            return func;
+        }
+
+        // 3x3、5x5: 以 BorderedRows 保留視窗內展開過的列
+        class MedianNetworkRowFilter : public RowFilter
+        {
+        public:
+            MedianNetworkRowFilter(const Mat& grayImage, int mask, BorderMode border)
+                : _image(grayImage), _mask(mask), _network(MedianNetworkOf(mask)), _medianRow(SelectMedianNetworkRow()), _paddedRows(_image, mask, border) {
+            }
+
+            void Row(int row, uchar* dst) override {
+                const uchar* windowRows[5];
+                _paddedRows.MoveTo(row);
+                for (int x = 0; x < _mask; x++)
+                    windowRows[x] = _paddedRows.Row(x);
+                _medianRow(windowRows, _mask, dst, _image.cols, _network);
+            }
+
+        private:
+            const Mat _image;
+            int _mask;
+            const MedianNetwork& _network;
+            MedianNetworkRowFunc _medianRow;
+            BorderedRows _paddedRows;
+        };
+
+        // 直方圖的 16 個粗分箱 (值 >> 4) 與 256 個細分箱
+        const int COARSE_BINS = 16;
+        const int FINE_BINS = 256;
+        const int FINE_PER_COARSE = FINE_BINS / COARSE_BINS;
+
+        template <typename Count>
+        inline void AddBins(Count* bins, const Count* added, const Count* removed, int binCount) {
+            for (int b = 0; b < binCount; b++)
+                bins[b] = (Count)(bins[b] + added[b] - removed[b]);
+        }
+
+        // 較大的 mask: Perreault–Hébert，每行保存 mask 列的直方圖，換列時只加入一個、移出一個像素
+        // 核心的粗直方圖每次加入右側行、減去左側行，細直方圖只在中位數落在該粗分箱時才更新到目前的位置
+        // 超出左右範圍的行依邊界模式對應到其他行的直方圖，Zero 時對應到最後多出的一行 (mask 個 0)
+        // 不是接續上一列時重新累計各行的直方圖
+        class MedianHistogramRowFilter : public RowFilter
+        {
+        public:
+            MedianHistogramRowFilter(const Mat& grayImage, int mask, BorderMode border)
+                : _image(grayImage), _mask(mask), _radius(mask / 2), _border(border) {
+                const int cols = grayImage.cols;
+                _columnCoarse.resize((size_t)(cols + 1) * COARSE_BINS);
+                _columnFine.resize((size_t)(cols + 1) * FINE_BINS);
+            }
+
+            void Row(int row, uchar* dst) override {
+                const int cols = _image.cols;
+                const int mask = _mask, radius = _radius;
+                const int rank = mask * mask / 2; // 中位數之前的個數
+                if (row == _row + 1 && _row >= 0) {
+                    this->UpdateColumns(row - 1 - radius, -1);
+                    this->UpdateColumns(row + radius, 1);
+                }
+                else {
+                    std::fill(_columnCoarse.begin(), _columnCoarse.end(), (uint16_t)0);
+                    std::fill(_columnFine.begin(), _columnFine.end(), (uint16_t)0);
+                    _columnCoarse[(size_t)cols * COARSE_BINS] = _columnFine[(size_t)cols * FINE_BINS] = (uint16_t)mask;
+                    for (int k = row - radius; k <= row + radius; k++)
+                        this->UpdateColumns(k, 1);
+                }
+                _row = row;
+
+                const uint16_t* columnCoarse = _columnCoarse.data();
+                const uint16_t* columnFine = _columnFine.data();
+                const BorderMode border = _border;
+                auto columnOf = [cols, border](int col) {
+                    const int index = BorderIndex(col, cols, border);
+                    return (size_t)(index < 0 ? cols : index);
+                };
+
+                uint16_t kernelCoarse[COARSE_BINS];
+                uint16_t kernelFine[FINE_BINS];
+                int fineColumn[COARSE_BINS];    // 各粗分箱的細直方圖對應的視窗中心行
+                std::fill(kernelCoarse, kernelCoarse + COARSE_BINS, 0);
+                for (int k = -radius; k <= radius; k++) {
+                    const uint16_t* bins = &columnCoarse[columnOf(k) * COARSE_BINS];
+                    for (int b = 0; b < COARSE_BINS; b++)
+                        kernelCoarse[b] = (uint16_t)(kernelCoarse[b] + bins[b]);
+                }
+                std::fill(fineColumn, fineColumn + COARSE_BINS, -mask);
+
+                for (int col = 0; col < cols; col++) {
+                    if (col > 0)
+                        AddBins(kernelCoarse, &columnCoarse[columnOf(col + radius) * COARSE_BINS],
+                            &columnCoarse[columnOf(col - 1 - radius) * COARSE_BINS], COARSE_BINS);
+
+                    // 中位數所在的粗分箱
+                    int count = 0, coarse = 0;
+                    while (count + kernelCoarse[coarse] <= rank)
+                        count += kernelCoarse[coarse++];
+
+                    // 將該粗分箱的細直方圖更新到目前的行，距離太遠時直接重新累加 mask 行
+                    const int offset = coarse * FINE_PER_COARSE;
+                    uint16_t* fine = &kernelFine[offset];
+                    if (2 * (col - fineColumn[coarse]) > mask) {
+                        std::fill(fine, fine + FINE_PER_COARSE, 0);
+                        for (int k = col - radius; k <= col + radius; k++) {
+                            const uint16_t* bins = &columnFine[columnOf(k) * FINE_BINS + offset];
+                            for (int b = 0; b < FINE_PER_COARSE; b++)
+                                fine[b] = (uint16_t)(fine[b] + bins[b]);
+                        }
+                    }
+                    else {
+                        for (int t = fineColumn[coarse] + 1; t <= col; t++)
+                            AddBins(fine, &columnFine[columnOf(t + radius) * FINE_BINS + offset],
+                                &columnFine[columnOf(t - 1 - radius) * FINE_BINS + offset], FINE_PER_COARSE);
+                    }
+                    fineColumn[coarse] = col;
+
+                    int value = 0;
+                    while (count + fine[value] <= rank)
+                        count += fine[value++];
+                    dst[col] = (uchar)(offset + value);
+                }
+            }
+
+        private:
+            // 第 row 列 (可超出範圍) 的像素加入 (delta = 1) 或移出 (delta = -1) 各行的直方圖
+            void UpdateColumns(int row, int delta) {
+                const int cols = _image.cols, channels = _image.channels();
+                const int sourceRow = BorderIndex(row, _image.rows, _border);
+                const uchar* src = sourceRow < 0 ? nullptr : _image.ptr<uchar>(sourceRow);
+                for (int col = 0; col < cols; col++) {
+                    const uchar value = src ? src[col * channels] : 0;
+                    _columnCoarse[(size_t)col * COARSE_BINS + (value >> 4)] += (uint16_t)delta;
+                    _columnFine[(size_t)col * FINE_BINS + value] += (uint16_t)delta;
+                }
+            }
+
+            const Mat _image;
+            int _mask;
+            int _radius;
+            BorderMode _border;
+            int _row = -1;
+            std::vector<uint16_t> _columnCoarse, _columnFine;
+        };
+
+        // mask = 1: 只取出第一個通道
+        class CopyRowFilter : public RowFilter
+        {
+        public:
+            explicit CopyRowFilter(const Mat& grayImage) : _image(grayImage) {}
+
+            void Row(int row, uchar* dst) override {
+                const uchar* src = _image.ptr<uchar>(row);
+                for (int col = 0; col < _image.cols; col++)
+                    dst[col] = src[col * _image.channels()];
+            }
+
+        private:
+            const Mat _image;
+        };
+
+        // 中值濾波的 RowFilter (MedianFilterGray 與 MedianFilterGrayTimes 共用)
+        inline RowFilterFactory MedianRowFilterOf(int mask, BorderMode border) {
+            return [mask, border](const Mat& grayImage) -> std::unique_ptr<RowFilter> {
+                if (mask == 1)
+                    return std::unique_ptr<RowFilter>(new CopyRowFilter(grayImage));
+                if (mask <= 5)
+                    return std::unique_ptr<RowFilter>(new MedianNetworkRowFilter(grayImage, mask, border));
+                return std::unique_ptr<RowFilter>(new MedianHistogramRowFilter(grayImage, mask, border));
+            };
+        }
+
+        inline size_t MedianFilterBytesPerRow(const Mat& grayImage, int mask, int dstChannels) {
+            return (size_t)grayImage.cols * (grayImage.channels() + dstChannels + mask);
+        }
+
+        // 中值濾波的 RowFilter 保留的資料量: 比較網路為 mask 列展開的列，直方圖為各行的粗、細直方圖
+        inline size_t MedianFilterStageBytes(const Mat& grayImage, int mask) {
+            if (mask <= 5)
+                return (size_t)(grayImage.cols + mask) * mask;
+            return (size_t)(grayImage.cols + 1) * (COARSE_BINS + FINE_BINS) * sizeof(uint16_t);
+        }
+    }
+
+    // 中值濾波 (mask x mask，邊界依 border 取值)，結果與排序後取中間值相同
+    // 3x3、5x5 以比較網路 (min / max) 同時處理相鄰的 16 / 32 個像素，較大的 mask 以直方圖計算，每個像素的計算量與 mask 無關
+    // 只讀取第一個通道，dstChannels = 3 輸出三通道相同的 CV_8UC3
+    inline void MedianFilterGray(const Mat& grayImage, Mat& dst, int mask, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1) && mask * mask <= 0xFFFF && (dstChannels == 1 || dstChannels == 3));
+        // 以列區塊平行處理
+        FilterGrayRows(grayImage, dst, mask, dstChannels, detail::MedianFilterBytesPerRow(grayImage, mask, dstChannels), detail::MedianRowFilterOf(mask, border));
+    }
+
+    inline Mat MedianFilterGray(const Mat& grayImage, int mask, int dstChannels = 1, BorderMode border = BorderMode::Replicate) {
+        Mat dst;
+        MedianFilterGray(grayImage, dst, mask, dstChannels, border);
+        return dst;
+    }
+
+    // 連續做 times 次中值濾波，所有次數在同一次掃描中完成 (見 FilterGrayTimes)，結果與逐次呼叫 MedianFilterGray 相同
+    inline void MedianFilterGrayTimes(const Mat& grayImage, Mat& dst, int mask, int times, int dstChannels = 1, BorderMode border = BorderMode::Replicate, std::vector<Mat>* passes = nullptr) {
+        CV_Assert(grayImage.depth() == CV_8U && mask > 0 && (mask & 1) && mask * mask <= 0xFFFF);
+        FilterGrayTimes(grayImage, dst, mask, times, dstChannels, border, detail::MedianFilterBytesPerRow(grayImage, mask, dstChannels), detail::MedianFilterStageBytes(grayImage, mask), detail::MedianRowFilterOf(mask, border), passes);
+    }
+}
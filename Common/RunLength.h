@@ -0,0 +1,171 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <cstring>
+#include "BinaryKernel.h"
+
+namespace image_kernel {
+    using namespace cv;
+
+    namespace detail {
+        // 最低位的 1 的位置 (x != 0)
+        inline int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+            unsigned long index;
+            if (_BitScanForward(&index, (unsigned long)x))
+                return (int)index;
+            _BitScanForward(&index, (unsigned long)(x >> 32));
+            return (int)index + 32;
+#else
+            return __builtin_ctzll(x);
+#endif
+        }
+    }
+
+    // Run-length 二值圖，只記錄 foreground 像素的 run，依列由左至右排列
+    class RunLengthBinary
+    {
+    public:
+        // [start, end) 的連續 foreground 像素
+        struct Run
+        {
+            int start;
+            int end;
+        };
+
+        RunLengthBinary() {}
+
+        RunLengthBinary(int rows, int cols) {
+            this->Create(rows, cols);
+        }
+
+        // 清空並設定大小，之後依列以 AddRun / EndRow 填入
+        void Create(int rows, int cols) {
+            _rows = rows;
+            _cols = cols;
+            _runs.clear();
+            _rowStart.assign(1, 0);
+            _rowStart.reserve(rows + 1);
+        }
+
+        int Rows() const { return _rows; }
+        int Cols() const { return _cols; }
+        int RunCount() const { return (int)_runs.size(); }
+
+        // 第 row 列的 run 為 [RowBegin(row), RowEnd(row))，index 即為 RowBegin 起算的 run 序號
+        int RowFirstRun(int row) const { return _rowStart[row]; }
+        const Run* RowBegin(int row) const { return _runs.data() + _rowStart[row]; }
+        const Run* RowEnd(int row) const { return _runs.data() + _rowStart[row + 1]; }
+        const Run& At(int index) const { return _runs[index]; }
+
+        void AddRun(int start, int end) {
+            _runs.push_back({ start, end });
+        }
+
+        void EndRow() {
+            _rowStart.push_back((int)_runs.size());
+        }
+
+        // 一列 1 byte 一個像素，值為 foreground 的像素組成 run
+        void AddRow(const uchar* pixels, uchar foreground = 255) {
+            int col = 0;
+            while (col < _cols) {
+                while (col < _cols && pixels[col] != foreground)
+                    col++;
+                if (col == _cols)
+                    break;
+                int start = col;
+                while (col < _cols && pixels[col] == foreground)
+                    col++;
+                this->AddRun(start, col);
+            }
+            this->EndRow();
+        }
+
+        // 一列 1 bit 一個像素 (PackedBinary 格式，stride 為 8 的倍數)，位元為 bit 的像素組成 run
+        // 以 64 bit 為單位找下一個狀態改變的位置
+        void AddPackedRow(const uchar* bits, int stride, bool bit = true) {
+            const uint64_t invert = bit ? 0 : ~0ULL;
+            bool inside = false;
+            int runStart = 0;
+            for (int word = 0; word * 8 < stride; word++) {
+                uint64_t value;
+                memcpy(&value, bits + word * 8, sizeof(value));
+                value ^= invert;
+                int pos = 0;
+                while (true) {
+                    uint64_t search = (inside ? ~value : value) & (~0ULL << pos);
+                    if (search == 0)
+                        break;
+                    pos = detail::CountTrailingZeros(search);
+                    if (inside)
+                        this->AddClippedRun(runStart, word * 64 + pos);
+                    else
+                        runStart = word * 64 + pos;
+                    inside = !inside;
+                }
+            }
+            if (inside)
+                this->AddClippedRun(runStart, _cols);
+            this->EndRow();
+        }
+
+        // 轉回 CV_8UC1
+        Mat Decode(uchar foreground = 255, uchar background = 0) const {
+            Mat binaryImage(_rows, _cols, CV_8UC1, Scalar(background));
+            for (int row = 0; row < _rows; row++) {
+                uchar* pixels = binaryImage.ptr<uchar>(row);
+                for (const Run* run = this->RowBegin(row); run != this->RowEnd(row); run++)
+                    memset(pixels + run->start, foreground, run->end - run->start);
+            }
+            return binaryImage;
+        }
+
+        // 由 CV_8UC1 建立，值為 foreground 的像素組成 run
+        static RunLengthBinary Encode(const Mat& binaryImage, uchar foreground = 255) {
+            CV_Assert(binaryImage.type() == CV_8UC1);
+            RunLengthBinary runs(binaryImage.rows, binaryImage.cols);
+            for (int row = 0; row < binaryImage.rows; row++)
+                runs.AddRow(binaryImage.ptr<uchar>(row), foreground);
+            return runs;
+        }
+
+        // 由 PackedBinary 建立，位元為 bit 的像素組成 run
+        static RunLengthBinary Encode(const PackedBinary& packed, bool bit = true) {
+            RunLengthBinary runs(packed.Rows(), packed.Cols());
+            for (int row = 0; row < packed.Rows(); row++)
+                runs.AddPackedRow(packed.Row(row), packed.Stride(), bit);
+            return runs;
+        }
+
+    private:
+        int _rows = 0;
+        int _cols = 0;
+        std::vector<Run> _runs;
+        std::vector<int> _rowStart = std::vector<int>(1, 0); // 各列第一個 run 的 index，共 rows + 1 個
+
+        // 反向時補齊的位元也會成為 run，需截在 cols
+        void AddClippedRun(int start, int end) {
+            if (start < _cols)
+                this->AddRun(start, std::min(end, _cols));
+        }
+    };
+
+    // BGR 直接二值化成 run-length，foreground = 255 時 gray > threshold 的像素組成 run，0 時為 gray <= threshold
+    // 每列先以 SIMD 二值化成 1 bit，再以 64 bit 為單位找出 run
+    inline RunLengthBinary ConvertBgrToRunLength(const Mat& colorImage, uchar threshold = 128, GrayWeights grayWeights = GrayWeights::Luma, uchar foreground = 255) {
+        CV_Assert(colorImage.type() == CV_8UC3);
+        RunLengthBinary runs(colorImage.rows, colorImage.cols);
+        int weights[3];
+        detail::WeightsOf(grayWeights, weights);
+        detail::BinaryRowFunc binaryRow = detail::SelectBinaryRow();
+        const int stride = PackedBinary::StrideOf(colorImage.cols);
+        std::vector<uchar> bits(stride);
+        for (int row = 0; row < colorImage.rows; row++) {
+            std::fill(bits.begin(), bits.end(), 0);
+            binaryRow(colorImage.ptr<uchar>(row), bits.data(), colorImage.cols, weights, threshold, true);
+            runs.AddPackedRow(bits.data(), stride, foreground != 0);
+        }
+        return runs;
+    }
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC 不需標示即可使用 intrinsics，GCC/Clang 需以 target 屬性開啟指令集
+#if defined(IMAGE_KERNEL_X86) && !defined(_MSC_VER)
+#define IMAGE_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IMAGE_KERNEL_TARGET(isa)
+#endif
+
+#ifdef IMAGE_KERNEL_X86
+namespace image_kernel {
+    namespace simd {
+        inline bool CpuSupportsSse2() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+#else
+            return __builtin_cpu_supports("sse2");
+#endif
+        }
+
+        inline bool CpuSupportsAvx2() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuid(info, 1);
+            // 需要 OS 支援儲存 YMM 暫存器 (OSXSAVE + XCR0)
+            if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        // 6 個連續的 16 byte BGR 資料 (32 個像素) 經 5 層 unpack 後依序為 B0 B1 G0 G1 R0 R1 (各 16 個像素)
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void DeinterleaveBgrSse2(__m128i* v) {
+            for (int layer = 0; layer < 5; layer++) {
+                __m128i t0 = _mm_unpacklo_epi8(v[0], v[3]);
+                __m128i t1 = _mm_unpackhi_epi8(v[0], v[3]);
+                __m128i t2 = _mm_unpacklo_epi8(v[1], v[4]);
+                __m128i t3 = _mm_unpackhi_epi8(v[1], v[4]);
+                __m128i t4 = _mm_unpacklo_epi8(v[2], v[5]);
+                __m128i t5 = _mm_unpackhi_epi8(v[2], v[5]);
+                v[0] = t0; v[1] = t1; v[2] = t2; v[3] = t3; v[4] = t4; v[5] = t5;
+            }
+        }
+
+        // DeinterleaveBgrSse2 的反向: B0 B1 G0 G1 R0 R1 轉回 32 個 BGR 像素
+        IMAGE_KERNEL_TARGET("sse2")
+        inline void InterleaveBgrSse2(__m128i* v) {
+            const __m128i lowByte = _mm_set1_epi16(0x00FF);
+            for (int layer = 0; layer < 5; layer++) {
+                __m128i t[6];
+                for (int i = 0; i < 3; i++) {
+                    __m128i lo = v[i * 2], hi = v[i * 2 + 1];
+                    t[i] = _mm_packus_epi16(_mm_and_si128(lo, lowByte), _mm_and_si128(hi, lowByte));
+                    t[i + 3] = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+                }
+                for (int i = 0; i < 6; i++)
+                    v[i] = t[i];
+            }
+        }
+    }
+}
+#endif
@@ -0,0 +1,228 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace image_kernel {
+    // 共用的 thread pool，第一次使用時才建立 worker
+    // ParallelFor 會把 [begin, end) 切成 grain 大小的區塊，由呼叫端與 worker 一起領取執行
+    // 使用的執行緒數可由 SetMaxThreads (全域) 與 ThreadLimit (目前執行緒的呼叫) 限制
+    // body 丟出例外時不再領取新的區塊，等所有 worker 離開後在呼叫端重新丟出第一個例外
+    class ThreadPool
+    {
+    public:
+        typedef std::function<void(int begin, int end)> RangeBody;
+
+        static ThreadPool& Instance() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _wakeUp.notify_all();
+            for (std::thread& worker : _workers)
+                worker.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // 全域的執行緒數上限 (含呼叫端)，0 為使用全部
+        void SetMaxThreads(int threads) {
+            _maxThreads = std::max(threads, 0);
+        }
+
+        // 目前呼叫可使用的執行緒總數 (含呼叫端)
+        int ThreadCount() const {
+            int threads = (int)_workers.size() + 1;
+            if (_maxThreads > 0)
+                threads = std::min(threads, (int)_maxThreads);
+            if (CallThreadLimit() > 0)
+                threads = std::min(threads, CallThreadLimit());
+            return threads;
+        }
+
+        // 目前執行緒發出的 ParallelFor 的執行緒數上限，0 為不限制 (由 ThreadLimit 設定)
+        static int& CallThreadLimit() {
+            thread_local int limit = 0;
+            return limit;
+        }
+
+        void ParallelFor(int begin, int end, int grain, const RangeBody& body) {
+            grain = std::max(grain, 1);
+            const int threads = this->ThreadCount();
+            // 區塊只有一個、只用一個執行緒或已在平行區塊內 (巢狀呼叫) 時直接執行
+            if (end - begin <= grain || threads <= 1 || InsideParallelFor()) {
+                if (begin < end)
+                    body(begin, end);
+                return;
+            }
+
+            // 同一時間只跑一個工作
+            std::lock_guard<std::mutex> jobLock(_jobMutex);
+            Job job;
+            job.body = &body;
+            job.begin = begin;
+            job.end = end;
+            job.grain = grain;
+            job.next = begin;
+            job.activeWorkers = 0;
+            job.joinedWorkers = 0;
+            job.maxWorkers = threads - 1;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _job = &job;
+                _generation++;
+            }
+            _wakeUp.notify_all();
+
+            RunChunks(job);
+
+            // 等待所有 worker 離開這個工作 (RunChunks 不會丟出例外，job 在 worker 離開前不會被釋放)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _job = nullptr;
+                _jobDone.wait(lock, [&job]() { return job.activeWorkers == 0; });
+            }
+            if (job.error)
+                std::rethrow_exception(job.error);
+        }
+
+    private:
+        struct Job
+        {
+            const RangeBody* body;
+            int begin, end, grain;
+            std::atomic<int> next;
+            int activeWorkers;
+            int joinedWorkers;
+            int maxWorkers;
+            std::mutex errorMutex;
+            std::exception_ptr error;   // 第一個丟出的例外
+        };
+
+        std::vector<std::thread> _workers;
+        std::mutex _mutex;
+        std::mutex _jobMutex;
+        std::condition_variable _wakeUp;
+        std::condition_variable _jobDone;
+        Job* _job = nullptr;
+        unsigned long long _generation = 0;
+        bool _stop = false;
+        std::atomic<int> _maxThreads{ 0 };
+
+        ThreadPool() {
+            int workerCount = (int)std::thread::hardware_concurrency() - 1;
+            for (int i = 0; i < workerCount; i++)
+                _workers.emplace_back([this]() { this->WorkerLoop(); });
+        }
+
+        static bool& InsideParallelFor() {
+            thread_local bool inside = false;
+            return inside;
+        }
+
+        // 在區塊內時設定 InsideParallelFor，離開時 (含例外) 恢復
+        class InsideGuard
+        {
+        public:
+            InsideGuard() : _previous(InsideParallelFor()) { InsideParallelFor() = true; }
+            ~InsideGuard() { InsideParallelFor() = _previous; }
+            InsideGuard(const InsideGuard&) = delete;
+            InsideGuard& operator=(const InsideGuard&) = delete;
+
+        private:
+            bool _previous;
+        };
+
+        // 領取並執行區塊直到做完，body 的例外保存在 job 中，並讓其他執行緒不再領取
+        static void RunChunks(Job& job) {
+            InsideGuard inside;
+            try {
+                for (int chunk = job.next.fetch_add(job.grain); chunk < job.end; chunk = job.next.fetch_add(job.grain))
+                    (*job.body)(chunk, std::min(chunk + job.grain, job.end));
+            }
+            catch (...) {
+                job.next = job.end;
+                std::lock_guard<std::mutex> lock(job.errorMutex);
+                if (!job.error)
+                    job.error = std::current_exception();
+            }
+        }
+
+        void WorkerLoop() {
+            unsigned long long seen = 0;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _wakeUp.wait(lock, [this, &seen]() { return _stop || (_job != nullptr && _generation != seen); });
+                if (_stop)
+                    return;
+                seen = _generation;
+                Job* job = _job;
+                // 已達到這個工作的執行緒數上限
+                if (job->joinedWorkers >= job->maxWorkers)
+                    continue;
+                job->joinedWorkers++;
+                job->activeWorkers++;
+                lock.unlock();
+
+                RunChunks(*job);
+
+                lock.lock();
+                if (--job->activeWorkers == 0)
+                    _jobDone.notify_all();
+            }
+        }
+    };
+
+    // 以共用 thread pool 平行處理 [begin, end)
+    inline void ParallelFor(int begin, int end, int grain, const ThreadPool::RangeBody& body) {
+        ThreadPool::Instance().ParallelFor(begin, end, grain, body);
+    }
+
+    // 全域的執行緒數上限 (含呼叫端)，0 為使用全部
+    inline void SetMaxThreads(int threads) {
+        ThreadPool::Instance().SetMaxThreads(threads);
+    }
+
+    // 在範圍內限制目前執行緒發出的 ParallelFor 使用的執行緒數 (threads <= 0 時不改變)，離開範圍後恢復
+    class ThreadLimit
+    {
+    public:
+        explicit ThreadLimit(int threads) : _previous(ThreadPool::CallThreadLimit()) {
+            if (threads > 0)
+                ThreadPool::CallThreadLimit() = threads;
+        }
+
+        ~ThreadLimit() {
+            ThreadPool::CallThreadLimit() = _previous;
+        }
+
+        ThreadLimit(const ThreadLimit&) = delete;
+        ThreadLimit& operator=(const ThreadLimit&) = delete;
+
+    private:
+        int _previous;
+    };
+
+    const size_t L2_CACHE_BYTES = 256 * 1024;
+
+    // 以列為單位平行處理 rows 列時每個區塊的列數
+    // 區塊內約 bytesPerRow * 列數的資料放得進 L2，且每個執行緒約分到 4 個區塊以平衡負載，但至少 minRows 列
+    inline int RowGrain(int rows, size_t bytesPerRow, int minRows = 1) {
+        const int threads = ThreadPool::Instance().ThreadCount();
+        const size_t cacheRows = std::max<size_t>(L2_CACHE_BYTES / std::max<size_t>(bytesPerRow, 1), 1);
+        const int balancedRows = (rows + threads * 4 - 1) / (threads * 4);
+        const int grain = (int)std::min<size_t>(cacheRows, (size_t)std::max(balancedRows, 1));
+        return std::max(grain, std::max(minRows, 1));
+    }
+}
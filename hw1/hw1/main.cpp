@@ -1,19 +1,446 @@
 #include <iostream>
 #include <algorithm>
 #include <opencv2/opencv.hpp>
+#include "../../Common/BinaryKernel.h"
+#include "../../Common/GrayKernel.h"
+#include "../../Common/Simd.h"
+#include "../../Common/ThreadPool.h"
 
 using namespace std;
 using namespace cv;
 
+// color map 的最近色查表，建立一次後重複使用
+// 將 RGB 空間切成 32x32x32 個 cell，每個 cell 只保留可能成為最近色的候選色
+// 候選色依 index 由小到大排列，結果與逐一比較 256 色完全相同
+class ColorMapLookup
+{
+public:
+    ColorMapLookup() {}
+
+    ColorMapLookup(const Mat& colorMap) {
+        this->Build(colorMap);
+    }
+
+    // 依 colorMap 建立查表
+    void Build(const Mat& colorMap) {
+        _colorMap = colorMap.clone();
+        _size = min(colorMap.cols, 256);
+        _offsets.assign(CELL_NUM * CELL_NUM * CELL_NUM + 1, 0);
+        _candidates.clear();
+
+        const Vec3b* colors = _colorMap.ptr<Vec3b>(0);
+        vector<int> minDists(_size);
+        for (int b = 0; b < CELL_NUM; b++)
+            for (int g = 0; g < CELL_NUM; g++)
+                for (int r = 0; r < CELL_NUM; r++) {
+                    const int low[3] = { b * CELL_SIZE, g * CELL_SIZE, r * CELL_SIZE };
+
+                    // 每個顏色到 cell 的最近距離，以及 cell 內任一點到最近顏色的距離上限
+                    int bound = INT_MAX;
+                    for (int k = 0; k < _size; k++) {
+                        int minDist = 0, maxDist = 0;
+                        for (int c = 0; c < 3; c++) {
+                            int nearDiff = colors[k][c] < low[c] ? low[c] - colors[k][c] : (colors[k][c] > low[c] + CELL_SIZE - 1 ? colors[k][c] - (low[c] + CELL_SIZE - 1) : 0);
+                            int farDiff = max(abs(colors[k][c] - low[c]), abs(colors[k][c] - (low[c] + CELL_SIZE - 1)));
+                            minDist += nearDiff * nearDiff;
+                            maxDist += farDiff * farDiff;
+                        }
+                        minDists[k] = minDist;
+                        bound = min(bound, maxDist);
+                    }
+
+                    // 最近距離不超過上限的顏色才可能是最近色 (相等也保留，維持同距離取最小 index)
+                    for (int k = 0; k < _size; k++)
+                        if (minDists[k] <= bound)
+                            _candidates.push_back((uchar)k);
+                    _offsets[CellIndex(low[0], low[1], low[2]) + 1] = (int)_candidates.size();
+                }
+    }
+
+    // 是否為同一份 colorMap
+    bool IsBuiltFrom(const Mat& colorMap) const {
+        if (_colorMap.empty() || colorMap.cols != _colorMap.cols || colorMap.type() != _colorMap.type())
+            return false;
+        return memcmp(colorMap.ptr<Vec3b>(0), _colorMap.ptr<Vec3b>(0), _size * sizeof(Vec3b)) == 0;
+    }
+
+    // 取得最近色的 index
+    uchar NearestIndex(const Vec3b& color) const {
+        const int cell = CellIndex(color[0], color[1], color[2]);
+        const Vec3b* colors = _colorMap.ptr<Vec3b>(0);
+        uchar index = 0;
+        int minDist = INT_MAX;
+        for (int i = _offsets[cell]; i < _offsets[cell + 1]; i++) {
+            const Vec3b& mapColor = colors[_candidates[i]];
+            int dist =
+                (color[0] - mapColor[0]) * (color[0] - mapColor[0]) +
+                (color[1] - mapColor[1]) * (color[1] - mapColor[1]) +
+                (color[2] - mapColor[2]) * (color[2] - mapColor[2]);
+            if (dist < minDist) {
+                minDist = dist;
+                index = _candidates[i];
+            }
+        }
+        return index;
+    }
+
+    const Vec3b& Color(uchar index) const {
+        return _colorMap.ptr<Vec3b>(0)[index];
+    }
+
+private:
+    static const int CELL_BITS = 3;                 // 每個 cell 每通道涵蓋 2^3 個值
+    static const int CELL_SIZE = 1 << CELL_BITS;
+    static const int CELL_NUM = 256 >> CELL_BITS;   // 每通道 cell 數
+
+    Mat _colorMap;
+    int _size = 0;
+    vector<int> _offsets;       // 每個 cell 在 _candidates 的起點
+    vector<uchar> _candidates;  // 各 cell 的候選色 index
+
+    static int CellIndex(int b, int g, int r) {
+        return ((b >> CELL_BITS) * CELL_NUM + (g >> CELL_BITS)) * CELL_NUM + (r >> CELL_BITS);
+    }
+};
+
+// 重新取樣 (nearest / bilinear)，支援非整數及 X、Y 不同的倍率
+// 建立時先算好每欄、每列的來源 index 與定點權重，套用時以 row pointer 分兩次 (水平、垂直) 計算並依列平行處理
+class Resampler
+{
+public:
+    enum class Method
+    {
+        Nearest,
+        Bilinear,
+    };
+
+    // scaleX, scaleY: 輸出 / 輸入的倍率
+    Resampler(Size srcSize, double scaleX, double scaleY, Method method) {
+        this->_srcSize = srcSize;
+        this->_dstSize = Size(max(1, (int)floor(srcSize.width * scaleX + EPSILON)), max(1, (int)floor(srcSize.height * scaleY + EPSILON)));
+        this->_method = method;
+        this->_cols = CreateAxis(srcSize.width, _dstSize.width, scaleX);
+        this->_rows = CreateAxis(srcSize.height, _dstSize.height, scaleY);
+    }
+
+    Size DstSize() const {
+        return this->_dstSize;
+    }
+
+    Mat Apply(const Mat& srcImage) const {
+        CV_Assert(srcImage.depth() == CV_8U && srcImage.size() == _srcSize);
+        Mat dstImage(_dstSize, srcImage.type());
+        const int BAND_ROWS = 16;
+        image_kernel::ParallelFor(0, _dstSize.height, BAND_ROWS, [&](int begin, int end) {
+            if (_method == Method::Nearest)
+                this->NearestRows(srcImage, dstImage, begin, end);
+            else
+                this->BilinearRows(srcImage, dstImage, begin, end);
+        });
+        return dstImage;
+    }
+
+private:
+    static const int COEF_BITS = 11;            // 權重定點數位數
+    static const int COEF_ONE = 1 << COEF_BITS;
+    static constexpr double EPSILON = 1e-7;     // 消除 1 / scale 的浮點誤差
+
+    // 每個輸出座標對應的兩個來源 index 與第二個來源的權重
+    struct Axis
+    {
+        vector<int> index0;
+        vector<int> index1;
+        vector<int> weight1;
+    };
+
+    Size _srcSize;
+    Size _dstSize;
+    Method _method;
+    Axis _cols;
+    Axis _rows;
+
+    // 輸出座標 d 對應來源座標 d / scale (左上角對齊)
+    static Axis CreateAxis(int srcLength, int dstLength, double scale) {
+        Axis axis;
+        axis.index0.resize(dstLength);
+        axis.index1.resize(dstLength);
+        axis.weight1.resize(dstLength);
+        for (int d = 0; d < dstLength; d++) {
+            double position = d / scale;
+            int index = min((int)floor(position + EPSILON), srcLength - 1);
+            double fraction = min(max(position - index, 0.0), 1.0);
+            axis.index0[d] = index;
+            axis.index1[d] = min(index + 1, srcLength - 1);
+            // 超出最後一個像素時直接取邊界值
+            axis.weight1[d] = axis.index1[d] == index ? 0 : (int)(fraction * COEF_ONE + 0.5);
+        }
+        return axis;
+    }
+
+    void NearestRows(const Mat& srcImage, Mat& dstImage, int begin, int end) const {
+        const int channels = srcImage.channels();
+        const size_t rowBytes = (size_t)_dstSize.width * channels;
+        for (int i = begin; i < end; i++) {
+            uchar* dstRow = dstImage.ptr<uchar>(i);
+            // 來源列相同時直接複製上一列
+            if (i > begin && _rows.index0[i] == _rows.index0[i - 1]) {
+                memcpy(dstRow, dstImage.ptr<uchar>(i - 1), rowBytes);
+                continue;
+            }
+            const uchar* srcRow = srcImage.ptr<uchar>(_rows.index0[i]);
+            for (int j = 0; j < _dstSize.width; j++) {
+                const uchar* srcPixel = srcRow + _cols.index0[j] * channels;
+                for (int k = 0; k < channels; k++)
+                    dstRow[j * channels + k] = srcPixel[k];
+            }
+        }
+    }
+
+    // 水平內插一列來源，結果放大 COEF_ONE 倍
+    void HorizontalRow(const uchar* srcRow, int* buffer, int channels) const {
+        for (int j = 0; j < _dstSize.width; j++) {
+            const uchar* pixel0 = srcRow + _cols.index0[j] * channels;
+            const uchar* pixel1 = srcRow + _cols.index1[j] * channels;
+            const int weight1 = _cols.weight1[j];
+            const int weight0 = COEF_ONE - weight1;
+            for (int k = 0; k < channels; k++)
+                buffer[j * channels + k] = pixel0[k] * weight0 + pixel1[k] * weight1;
+        }
+    }
+
+    void BilinearRows(const Mat& srcImage, Mat& dstImage, int begin, int end) const {
+        const int channels = srcImage.channels();
+        const int rowLength = _dstSize.width * channels;
+        // 保留最近兩列水平內插結果，相鄰輸出列共用
+        vector<int> buffers[2] = { vector<int>(rowLength), vector<int>(rowLength) };
+        int bufferRows[2] = { -1, -1 };
+        auto HorizontalOf = [&](int srcRowIndex) -> const int* {
+            for (int b = 0; b < 2; b++)
+                if (bufferRows[b] == srcRowIndex)
+                    return buffers[b].data();
+            // 覆蓋較舊的一列
+            int b = bufferRows[0] < bufferRows[1] ? 0 : 1;
+            this->HorizontalRow(srcImage.ptr<uchar>(srcRowIndex), buffers[b].data(), channels);
+            bufferRows[b] = srcRowIndex;
+            return buffers[b].data();
+        };
+
+        const int SHIFT = COEF_BITS * 2;
+        const int ROUND = 1 << (SHIFT - 1);
+        for (int i = begin; i < end; i++) {
+            const int* row0 = HorizontalOf(_rows.index0[i]);
+            const int* row1 = HorizontalOf(_rows.index1[i]);
+            const int weight1 = _rows.weight1[i];
+            const int weight0 = COEF_ONE - weight1;
+            uchar* dstRow = dstImage.ptr<uchar>(i);
+            for (int j = 0; j < rowLength; j++)
+                dstRow[j] = (uchar)((row0[j] * weight0 + row1[j] * weight1 + ROUND) >> SHIFT);
+        }
+    }
+};
+
+// 區域平均縮小 (area average)，支援任意長寬比與整數、小數倍率
+// 每個輸出像素為其覆蓋範圍內來源像素依覆蓋比例的加權平均，整數倍率時即為區塊平均 (無條件捨去)
+// 先水平累加每列來源，再垂直累加成輸出列，每個來源像素只被累加常數次，計算量與倍率無關
+class AreaDownscaler
+{
+public:
+    // scaleX, scaleY: 輸出 / 輸入的倍率 (<= 1)
+    AreaDownscaler(Size srcSize, double scaleX, double scaleY) {
+        CV_Assert(scaleX > 0 && scaleX <= 1 && scaleY > 0 && scaleY <= 1);
+        this->_srcSize = srcSize;
+        this->_dstSize = Size(max(1, (int)floor(srcSize.width * scaleX + EPSILON)), max(1, (int)floor(srcSize.height * scaleY + EPSILON)));
+        this->_isHalf = scaleX == 0.5 && scaleY == 0.5;
+        this->_cols = CreateAxis(srcSize.width, _dstSize.width, scaleX);
+        this->_rows = CreateAxis(srcSize.height, _dstSize.height, scaleY);
+    }
+
+    Size DstSize() const {
+        return this->_dstSize;
+    }
+
+    Mat Apply(const Mat& srcImage) const {
+        CV_Assert(srcImage.depth() == CV_8U && srcImage.size() == _srcSize);
+        Mat dstImage(_dstSize, srcImage.type());
+        const int BAND_ROWS = 8;
+        image_kernel::ParallelFor(0, _dstSize.height, BAND_ROWS, [&](int begin, int end) {
+            if (_isHalf)
+                this->HalfRows(srcImage, dstImage, begin, end);
+            else
+                this->AreaRows(srcImage, dstImage, begin, end);
+        });
+        return dstImage;
+    }
+
+private:
+    static const int COVER_BITS = 8;                // 覆蓋比例的定點數位數
+    static constexpr double EPSILON = 1e-7;
+
+    // 每個輸出座標覆蓋的來源 index 與覆蓋量 [offsets[d], offsets[d + 1])
+    struct Axis
+    {
+        vector<int> offsets;
+        vector<int> srcIndex;
+        vector<int> weight;
+        vector<int> total;      // 覆蓋量總和
+    };
+
+    Size _srcSize;
+    Size _dstSize;
+    bool _isHalf;               // 長寬皆縮小一半
+    Axis _cols;
+    Axis _rows;
+
+    // 輸出座標 d 覆蓋來源 [d / scale, (d + 1) / scale)，以 1 / 2^COVER_BITS 像素為單位
+    static Axis CreateAxis(int srcLength, int dstLength, double scale) {
+        Axis axis;
+        axis.offsets.push_back(0);
+        for (int d = 0; d < dstLength; d++) {
+            long long begin = (long long)floor(d / scale * (1 << COVER_BITS) + 0.5);
+            long long end = min((long long)floor((d + 1) / scale * (1 << COVER_BITS) + 0.5), (long long)srcLength << COVER_BITS);
+            int total = 0;
+            for (int i = (int)(begin >> COVER_BITS); ((long long)i << COVER_BITS) < end; i++) {
+                long long pixelBegin = (long long)i << COVER_BITS;
+                int weight = (int)(min(end, pixelBegin + (1 << COVER_BITS)) - max(begin, pixelBegin));
+                if (weight <= 0)
+                    continue;
+                axis.srcIndex.push_back(i);
+                axis.weight.push_back(weight);
+                total += weight;
+            }
+            axis.offsets.push_back((int)axis.srcIndex.size());
+            axis.total.push_back(total);
+        }
+        return axis;
+    }
+
+    // 水平累加一列來源
+    void HorizontalRow(const uchar* srcRow, int* buffer, int channels) const {
+        for (int j = 0; j < _dstSize.width; j++) {
+            int sum[4] = { 0, 0, 0, 0 };
+            for (int n = _cols.offsets[j]; n < _cols.offsets[j + 1]; n++) {
+                const uchar* pixel = srcRow + _cols.srcIndex[n] * channels;
+                for (int k = 0; k < channels; k++)
+                    sum[k] += pixel[k] * _cols.weight[n];
+            }
+            for (int k = 0; k < channels; k++)
+                buffer[j * channels + k] = sum[k];
+        }
+    }
+
+    void AreaRows(const Mat& srcImage, Mat& dstImage, int begin, int end) const {
+        const int channels = srcImage.channels();
+        CV_Assert(channels <= 4);
+        const int rowLength = _dstSize.width * channels;
+        vector<int> buffer(rowLength);
+        vector<long long> accumulator(rowLength);
+        for (int i = begin; i < end; i++) {
+            std::fill(accumulator.begin(), accumulator.end(), 0LL);
+            for (int n = _rows.offsets[i]; n < _rows.offsets[i + 1]; n++) {
+                this->HorizontalRow(srcImage.ptr<uchar>(_rows.srcIndex[n]), buffer.data(), channels);
+                const int weight = _rows.weight[n];
+                for (int j = 0; j < rowLength; j++)
+                    accumulator[j] += (long long)buffer[j] * weight;
+            }
+
+            uchar* dstRow = dstImage.ptr<uchar>(i);
+            for (int j = 0; j < _dstSize.width; j++) {
+                const long long area = (long long)_cols.total[j] * _rows.total[i];
+                for (int k = 0; k < channels; k++)
+                    dstRow[j * channels + k] = (uchar)(accumulator[j * channels + k] / area);
+            }
+        }
+    }
+
+    // 2x2 區塊平均 (無條件捨去)
+    static void HalfRowScalar(const uchar* row0, const uchar* row1, uchar* dstRow, int dstWidth, int channels) {
+        for (int j = 0; j < dstWidth; j++)
+            for (int k = 0; k < channels; k++) {
+                const int a = j * 2 * channels + k;
+                dstRow[j * channels + k] = (uchar)((row0[a] + row0[a + channels] + row1[a] + row1[a + channels]) >> 2);
+            }
+    }
+
+#ifdef IMAGE_KERNEL_X86
+    // 16 個相鄰像素兩兩相加，再加上下一列的結果: 8 個 2x2 總和 / 4
+    IMAGE_KERNEL_TARGET("sse2")
+    static __m128i HalfSumSse2(__m128i top, __m128i bottom) {
+        const __m128i lowByte = _mm_set1_epi16(0x00FF);
+        __m128i topSum = _mm_add_epi16(_mm_and_si128(top, lowByte), _mm_srli_epi16(top, 8));
+        __m128i bottomSum = _mm_add_epi16(_mm_and_si128(bottom, lowByte), _mm_srli_epi16(bottom, 8));
+        return _mm_srli_epi16(_mm_add_epi16(topSum, bottomSum), 2);
+    }
+
+    // 單通道每次輸出 16 個像素，三通道先拆成 B、G、R 平面，每次輸出 32 個像素
+    IMAGE_KERNEL_TARGET("sse2")
+    static int HalfRowSse2(const uchar* row0, const uchar* row1, uchar* dstRow, int dstWidth, int channels) {
+        int j = 0;
+        if (channels == 1) {
+            for (; j + 16 <= dstWidth; j += 16) {
+                const uchar* top = row0 + j * 2;
+                const uchar* bottom = row1 + j * 2;
+                __m128i lo = HalfSumSse2(_mm_loadu_si128((const __m128i*)top), _mm_loadu_si128((const __m128i*)bottom));
+                __m128i hi = HalfSumSse2(_mm_loadu_si128((const __m128i*)(top + 16)), _mm_loadu_si128((const __m128i*)(bottom + 16)));
+                _mm_storeu_si128((__m128i*)(dstRow + j), _mm_packus_epi16(lo, hi));
+            }
+        }
+        else if (channels == 3) {
+            for (; j + 32 <= dstWidth; j += 32) {
+                // 來源 64 個像素，分兩組各 32 個像素拆成平面
+                __m128i top[2][6], bottom[2][6];
+                for (int group = 0; group < 2; group++) {
+                    for (int i = 0; i < 6; i++) {
+                        top[group][i] = _mm_loadu_si128((const __m128i*)(row0 + (j * 2 + group * 32) * 3 + i * 16));
+                        bottom[group][i] = _mm_loadu_si128((const __m128i*)(row1 + (j * 2 + group * 32) * 3 + i * 16));
+                    }
+                    image_kernel::simd::DeinterleaveBgrSse2(top[group]);
+                    image_kernel::simd::DeinterleaveBgrSse2(bottom[group]);
+                }
+                __m128i planes[6];
+                for (int c = 0; c < 3; c++)
+                    for (int group = 0; group < 2; group++)
+                        planes[c * 2 + group] = _mm_packus_epi16(
+                            HalfSumSse2(top[group][c * 2], bottom[group][c * 2]),
+                            HalfSumSse2(top[group][c * 2 + 1], bottom[group][c * 2 + 1]));
+                image_kernel::simd::InterleaveBgrSse2(planes);
+                for (int i = 0; i < 6; i++)
+                    _mm_storeu_si128((__m128i*)(dstRow + j * 3 + i * 16), planes[i]);
+            }
+        }
+        return j;
+    }
+#endif
+
+    void HalfRows(const Mat& srcImage, Mat& dstImage, int begin, int end) const {
+        const int channels = srcImage.channels();
+#ifdef IMAGE_KERNEL_X86
+        static const bool useSse2 = image_kernel::simd::CpuSupportsSse2();
+#endif
+        for (int i = begin; i < end; i++) {
+            const uchar* row0 = srcImage.ptr<uchar>(i * 2);
+            const uchar* row1 = srcImage.ptr<uchar>(i * 2 + 1);
+            uchar* dstRow = dstImage.ptr<uchar>(i);
+            int j = 0;
+#ifdef IMAGE_KERNEL_X86
+            if (useSse2)
+                j = HalfRowSse2(row0, row1, dstRow, _dstSize.width, channels);
+#endif
+            HalfRowScalar(row0 + j * 2 * channels, row1 + j * 2 * channels, dstRow + j * channels, _dstSize.width - j, channels);
+        }
+    }
+};
+
 class ImageLibrary 
 {
 private:
     Mat _colorMap;
+    ColorMapLookup _colorMapLookup;     // _colorMap 的查表
+    ColorMapLookup _userColorMapLookup; // 最近一次使用者給的 colorMap 查表
 
-    // إ indexed image  color map
+    // 建立 indexed image 的 color map
     void CreateColorMap() {
         _colorMap = Mat(1, 256, CV_8UC3);
-        // B 4, G 8, R 8 = 4 * 8 * 8 = 256
+        // B 4種, G 8種, R 8種 = 4 * 8 * 8 = 256
         int colorDiv[3] = { 4, 8, 8 };
         for (int i = 0; i < colorDiv[0]; i++)
             for (int j = 0; j < colorDiv[1]; j++)
@@ -21,66 +448,23 @@ private:
                     int index = i * colorDiv[1] * colorDiv[2] + j * colorDiv[2] + k;
                     _colorMap.at<Vec3b>(0, index) = Vec3b(i * (256 / colorDiv[0]), j * (256 / colorDiv[1]), k * (256 / colorDiv[2]));
                 }
+        _colorMapLookup.Build(_colorMap);
     }
 
     Mat ResizeWithoutInterpolation(Mat colorImage, int scale, bool zoomIn) {
-        Mat resizeImage;
-        if (zoomIn) {
-            resizeImage = Mat(colorImage.rows * scale, colorImage.cols * scale, CV_8UC3);
-            for (int i = 0; i < resizeImage.rows; i++)
-                for (int j = 0; j < resizeImage.cols; j++)
-                    resizeImage.at<Vec3b>(i, j) = colorImage.at<Vec3b>(i / scale, j / scale);
-        }
-        else {
-            resizeImage = Mat(colorImage.rows / scale, colorImage.cols / scale, CV_8UC3);
-            for (int i = 0; i < resizeImage.rows; i++)
-                for (int j = 0; j < resizeImage.cols; j++)
-                    resizeImage.at<Vec3b>(i, j) = colorImage.at<Vec3b>(scale * i, scale * j);
-        }
-        return resizeImage;
+        double factor = zoomIn ? scale : 1.0 / scale;
+        return Resampler(colorImage.size(), factor, factor, Resampler::Method::Nearest).Apply(colorImage);
     }
 
     Mat ResizeWithInterpolation(Mat colorImage, int scale, bool zoomIn) {
         Mat resizeImage;
         if (zoomIn) {
             // Bilinear Interpolation
-            int height = colorImage.rows;
-            int width = colorImage.cols;
-
-            int new_height = height * scale;
-            int new_width = width * scale;
-
-            resizeImage = Mat(new_height, new_width, CV_8UC3);
-
-            for (int i = 0; i < new_height; i++)
-                for (int j = 0; j < new_width; j++) 
-                    for (int k = 0; k < 3; k++) {
-                        double x = (double)j / scale;
-                        double y = (double)i / scale;
-                        int x1 = (int)x;
-                        int x2 = min(x1 + 1, width - 1);
-                        int y1 = (int)y;
-                        int y2 = min(y1 + 1, height - 1);
-                        double fx1 = (x2 - x) / ((double)x2 - x1) * colorImage.at<Vec3b>(y1, x1)[k] + (x - x1) / ((double)x2 - x1) * colorImage.at<Vec3b>(y1, x2)[k];
-                        double fx2 = (x2 - x) / ((double)x2 - x1) * colorImage.at<Vec3b>(y2, x1)[k] + (x - x1) / ((double)x2 - x1) * colorImage.at<Vec3b>(y2, x2)[k];
-                        double fy = (y2 - y) / ((double)y2 - y1) * fx1 + (y - y1) / ((double)y2 - y1) * fx2;
-                        resizeImage.at<Vec3b>(i, j)[k] = (uchar)fy;
-                    }
+            resizeImage = Resampler(colorImage.size(), scale, scale, Resampler::Method::Bilinear).Apply(colorImage);
         }
         else {
-            resizeImage = Mat(colorImage.rows / scale, colorImage.cols / scale, CV_8UC3);
-            for (int w = 0; w < resizeImage.rows; w++)
-                for (int h = 0; h < resizeImage.cols; h++) {
-                    uchar color[3] = { 0, 0, 0 };
-                    for (int k = 0; k < 3; k++) {
-                        int sum = 0;
-                        for (int i = 0; i < scale; i++)
-                            for (int j = 0; j < scale; j++)
-                                sum += colorImage.at<Vec3b>(h * scale + i, w * scale + j)[k];
-                        color[k] = sum / (scale * scale);
-                    }
-                    resizeImage.at<Vec3b>(h, w) = Vec3b(color[0], color[1], color[2]);
-                }
+            // Area Average
+            resizeImage = AreaDownscaler(colorImage.size(), 1.0 / scale, 1.0 / scale).Apply(colorImage);
         }
         return resizeImage;
     }
@@ -94,66 +478,57 @@ public:
         return this->_colorMap;
     }
 
-    // Ƕ
+    // 轉灰階
     Mat ConvertToGray(Mat colorImage) {
-        Mat grayImage(colorImage.size(), CV_8UC1);
-
-        for (int i = 0; i < colorImage.rows; i++) {
-            for (int j = 0; j < colorImage.cols; j++) {
-                Vec3b pixel = colorImage.at<Vec3b>(i, j);
-                int grayValue = 0.3 * pixel[2] + 0.59 * pixel[1] + 0.11 * pixel[0];
-                grayImage.at<uchar>(i, j) = grayValue;
-            }
-        }
-        return grayImage;
+        // 0.3 R + 0.59 G + 0.11 B
+        return image_kernel::ConvertBgrToGray(colorImage, image_kernel::GrayWeights::Luma);
     }
 
-    // ǶGȤ
+    // 灰階二值化
     Mat ConvertToBinary(Mat colorImage, uchar threshold = 128) {
-        Mat grayImage = this->ConvertToGray(colorImage);
-        Mat binaryImage(grayImage.size(), CV_8UC1);
-
-        for (int i = 0; i < grayImage.rows; i++)
-            for (int j = 0; j < grayImage.cols; j++)
-                binaryImage.at<uchar>(i, j) = grayImage.at<uchar>(i, j) > threshold ? 255 : 0;
-        return binaryImage;
+        // 灰階與二值化一次完成，不產生灰階圖
+        return image_kernel::ConvertBgrToBinary(colorImage, threshold, image_kernel::GrayWeights::Luma);
     }
 
-    // ϥιন indexed image
+    // 使用對應表轉成 indexed image
     Mat ConvertToIndexedColor(Mat colorImage, Mat* colorMap = nullptr) {
         if (colorMap == nullptr)
             colorMap =  &(this->_colorMap);
 
+        // 使用者的 colorMap 與上次不同時才重建查表
+        const ColorMapLookup* lookup = &(this->_colorMapLookup);
+        if (!this->_colorMapLookup.IsBuiltFrom(*colorMap)) {
+            if (!this->_userColorMapLookup.IsBuiltFrom(*colorMap))
+                this->_userColorMapLookup.Build(*colorMap);
+            lookup = &(this->_userColorMapLookup);
+        }
+
         Mat indexImage(colorImage.size(), CV_8UC1);
         Mat mappingImage(colorImage.size(), CV_8UC3);
-        const int MAX_DIST = 255.0 * 255.0 * 3.0;
         for (int i = 0; i < colorImage.rows; i++) {
+            const Vec3b* colorRow = colorImage.ptr<Vec3b>(i);
+            uchar* indexRow = indexImage.ptr<uchar>(i);
+            Vec3b* mappingRow = mappingImage.ptr<Vec3b>(i);
             for (int j = 0; j < colorImage.cols; j++) {
-                Vec3b color = colorImage.at<Vec3b>(i, j);
-                uchar index = 0;
-                int minDist = MAX_DIST;
-                for (int k = 0; k < 256; k++) {
-                    Vec3b mapColor = colorMap->at<Vec3b>(0, k);
-                    int dist =
-                        (color[0] - mapColor[0]) * (color[0] - mapColor[0]) +
-                        (color[1] - mapColor[1]) * (color[1] - mapColor[1]) +
-                        (color[2] - mapColor[2]) * (color[2] - mapColor[2]);
-                    if (dist < minDist) {
-                        minDist = dist;
-                        index = k;
-                    }
-                }
-                indexImage.at<uchar>(i, j) = index;
-                mappingImage.at<Vec3b>(i, j) = colorMap->at<Vec3b>(0, index);
+                uchar index = lookup->NearestIndex(colorRow[j]);
+                indexRow[j] = index;
+                mappingRow[j] = lookup->Color(index);
             }
         }
         return mappingImage;
     }
 
-    // Resize scale:jYpơAzoomIn = true jϤYpAinterpolation = true with interpolation
+    // Resize scale:放大縮小倍數，zoomIn = true 放大反之縮小，interpolation = true with interpolation
     Mat Resize(Mat colorImage, int scale, bool zoomIn = true, bool interpolation = false) {
         return interpolation ? ResizeWithInterpolation(colorImage, scale, zoomIn) : ResizeWithoutInterpolation(colorImage, scale, zoomIn);
     }
+
+    // ResizeByFactor scaleX, scaleY:輸出 / 輸入的倍率 (可為小數)，interpolation = true 放大使用 bilinear、縮小使用 area average，反之 nearest
+    Mat ResizeByFactor(Mat colorImage, double scaleX, double scaleY, bool interpolation = false) {
+        if (interpolation && scaleX <= 1 && scaleY <= 1)
+            return AreaDownscaler(colorImage.size(), scaleX, scaleY).Apply(colorImage);
+        return Resampler(colorImage.size(), scaleX, scaleY, interpolation ? Resampler::Method::Bilinear : Resampler::Method::Nearest).Apply(colorImage);
+    }
 };
 
 int main() {
@@ -0,0 +1,140 @@
+﻿#include "ComponentTree.h"
+
+namespace image_model {
+    namespace {
+        int FindRoot(std::vector<int>& zpar, int x) {
+            int root = x;
+            while (zpar[root] != root)
+                root = zpar[root];
+            while (zpar[x] != root) {
+                int next = zpar[x];
+                zpar[x] = root;
+                x = next;
+            }
+            return root;
+        }
+    }
+
+    ComponentTree::ComponentTree(const Mat& grayImage, int connectivity) {
+        CV_Assert(grayImage.type() == CV_8UC1);
+        _rows = grayImage.rows;
+        _cols = grayImage.cols;
+        _grayImage = grayImage.isContinuous() ? grayImage : grayImage.clone();
+        const int pixelNum = _rows * _cols;
+        const uchar* gray = _grayImage.data;
+
+        // counting sort，同灰階依掃描順序
+        std::vector<int> histogram(LEVEL_NUM + 1, 0);
+        for (int pixel = 0; pixel < pixelNum; pixel++)
+            histogram[gray[pixel] + 1]++;
+        for (int level = 0; level < LEVEL_NUM; level++)
+            histogram[level + 1] += histogram[level];
+        _sorted.resize(pixelNum);
+        for (int pixel = 0; pixel < pixelNum; pixel++)
+            _sorted[histogram[gray[pixel]]++] = pixel;
+
+        // 依序加入像素，與已加入的鄰居合併，被合併的節點以新像素為父節點
+        // zpar 以 rank 合併並做路徑壓縮，repr 紀錄每個集合目前的樹節點
+        const int OFFSET_NUM = connectivity == 8 ? 8 : 4;
+        const int DROW[8] = { -1, 0, 0, 1, -1, -1, 1, 1 };
+        const int DCOL[8] = { 0, -1, 1, 0, -1, 1, -1, 1 };
+        std::vector<int> zpar(pixelNum, -1);
+        std::vector<int> rank(pixelNum, 0);
+        std::vector<int> repr(pixelNum);
+        _parent.resize(pixelNum);
+        _area.assign(pixelNum, 1);
+        for (int pixel : _sorted) {
+            const int row = pixel / _cols;
+            const int col = pixel % _cols;
+            _parent[pixel] = pixel;
+            zpar[pixel] = pixel;
+            repr[pixel] = pixel;
+            int root = pixel;
+            for (int k = 0; k < OFFSET_NUM; k++) {
+                const int nRow = row + DROW[k];
+                const int nCol = col + DCOL[k];
+                if (nRow < 0 || nRow >= _rows || nCol < 0 || nCol >= _cols)
+                    continue;
+                const int neighbor = nRow * _cols + nCol;
+                if (zpar[neighbor] < 0)
+                    continue;
+                int neighborRoot = FindRoot(zpar, neighbor);
+                if (neighborRoot == root)
+                    continue;
+
+                const int node = repr[neighborRoot];
+                _parent[node] = pixel;
+                _area[pixel] += _area[node];
+                if (rank[root] < rank[neighborRoot])
+                    std::swap(root, neighborRoot);
+                zpar[neighborRoot] = root;
+                if (rank[root] == rank[neighborRoot])
+                    rank[root]++;
+                repr[root] = pixel;
+            }
+        }
+
+        // 正規化: 由根節點往下，父節點與祖父節點同灰階時改指向祖父節點
+        for (int i = pixelNum - 1; i >= 0; i--) {
+            const int pixel = _sorted[i];
+            const int parent = _parent[pixel];
+            if (this->LevelOf(_parent[parent]) == this->LevelOf(parent))
+                _parent[pixel] = _parent[parent];
+        }
+    }
+
+    std::vector<int> ComponentTree::CountObjects(int sizeFilter) const {
+        // 節點在 [自身灰階, 父節點灰階) 的門檻值內為一個物件
+        std::vector<int> counts(LEVEL_NUM + 1, 0);
+        for (int pixel : _sorted) {
+            if (!this->IsCanonical(pixel) || _area[pixel] <= sizeFilter)
+                continue;
+            counts[this->LevelOf(pixel)]++;
+            if (_parent[pixel] != pixel)
+                counts[this->LevelOf(_parent[pixel])]--;
+        }
+        for (int level = 1; level < LEVEL_NUM; level++)
+            counts[level] += counts[level - 1];
+        counts.pop_back();
+        return counts;
+    }
+
+    Mat ComponentTree::LabelMap(uchar threshold, std::vector<int>* objSizes) const {
+        const int pixelNum = _rows * _cols;
+        // 每個節點在門檻值下所屬的物件節點，由根節點往下決定
+        std::vector<int> objectNode(pixelNum, -1);
+        for (int i = pixelNum - 1; i >= 0; i--) {
+            const int pixel = _sorted[i];
+            if (this->LevelOf(pixel) > threshold)
+                continue;
+            const int parent = _parent[pixel];
+            if (!this->IsCanonical(pixel))
+                objectNode[pixel] = objectNode[parent];
+            else if (parent != pixel && this->LevelOf(parent) <= threshold)
+                objectNode[pixel] = objectNode[parent];
+            else
+                objectNode[pixel] = pixel;
+        }
+
+        // 依物件第一個像素的掃描順序編號
+        Mat labels(_rows, _cols, CV_32S);
+        std::vector<int> nodeLabel(pixelNum, 0);
+        std::vector<int> objSize(1, 0);
+        int* label = labels.ptr<int>(0);
+        for (int pixel = 0; pixel < pixelNum; pixel++) {
+            const int node = objectNode[pixel];
+            if (node < 0) {
+                label[pixel] = 0;
+                continue;
+            }
+            if (!nodeLabel[node]) {
+                nodeLabel[node] = (int)objSize.size();
+                objSize.push_back(_area[node]);
+            }
+            label[pixel] = nodeLabel[node];
+        }
+        if (objSizes != nullptr)
+            *objSizes = objSize;
+        return labels;
+    }
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace cv;
+
+namespace image_model {
+    // 灰階圖的 component tree，節點為各門檻值 t 下 gray <= t 像素的連通區域
+    // 像素依灰階由小到大加入，以 union-find 合併已加入的鄰居 (Berger 演算法)
+    // 建立一次後即可查詢任意門檻值的物件數與 label map，不需重新二值化與 labeling
+    class ComponentTree
+    {
+    public:
+        static const int LEVEL_NUM = 256;
+
+        // grayImage: CV_8UC1，connectivity: 4 或 8
+        ComponentTree(const Mat& grayImage, int connectivity = 4);
+
+        // 各門檻值 (0 ~ 255) 下面積大於 sizeFilter 的物件數
+        std::vector<int> CountObjects(int sizeFilter = -1) const;
+
+        // 門檻值 threshold 下的 label map (CV_32S)，與對 gray > threshold 二值化後 labeling 的結果相同
+        // objSizes: 各 label 的物件大小，objSizes[0] 不使用
+        Mat LabelMap(uchar threshold, std::vector<int>* objSizes = nullptr) const;
+
+    private:
+        int _rows;
+        int _cols;
+        Mat _grayImage;
+        std::vector<int> _sorted;   // 依灰階由小到大排列的像素 index
+        std::vector<int> _parent;   // 正規化後的父節點，根節點指向自己
+        std::vector<int> _area;     // 以此像素為代表的節點面積
+
+        uchar LevelOf(int pixel) const {
+            return _grayImage.data[pixel];
+        }
+
+        // 代表節點: 根節點或父節點灰階較大
+        bool IsCanonical(int pixel) const {
+            return _parent[pixel] == pixel || this->LevelOf(_parent[pixel]) != this->LevelOf(pixel);
+        }
+    };
+}
@@ -1,83 +1,73 @@
 #include "ImageLibrary.h"
 #include <iostream>
-#include <queue>
 
 namespace image_model {
-    // Ƕ
-    Mat ImageLibrary::ConvertToGray(Mat colorImage) {
-        Mat grayImage(colorImage.size(), CV_8UC1);
-
-        for (int row = 0; row < grayImage.rows; row++) {
-            for (int col = 0; col < grayImage.cols; col++) {
-                Vec3b pixel = colorImage.at<Vec3b>(row, col);
-                //int grayValue = (int)(0.3 * pixel[2] + 0.59 * pixel[1] + 0.11 * pixel[0]);
-                int grayValue = (int)(0.34 * pixel[2] + 0.33 * pixel[1] + 0.33 * pixel[0]);
-                grayImage.at<uchar>(row, col) = grayValue;
-            }
+    namespace {
+        // 結束逐列輸入，只保留面積大於 sizeFilter 的物件
+        vector<ComponentStats> FilterStats(ComponentStatsAccumulator& accumulator, int sizeFilter) {
+            vector<ComponentStats> stats;
+            accumulator.Finish(stats);
+            vector<ComponentStats> objects;
+            for (int objLabel = 1; objLabel < stats.size(); objLabel++)
+                if (stats[objLabel].area > sizeFilter)
+                    objects.push_back(stats[objLabel]);
+            return objects;
         }
-        return grayImage;
     }
 
-    // GȤ
+    // 轉灰階
+    Mat ImageLibrary::ConvertToGray(Mat colorImage) {
+        //return image_kernel::ConvertBgrToGray(colorImage, image_kernel::GrayWeights::Luma);
+        return image_kernel::ConvertBgrToGray(colorImage, image_kernel::GrayWeights::Balanced);
+    }
+
+    // 二值化
     Mat ImageLibrary::ConvertToBinary(Mat colorImage, uchar threshold) {
-        Mat grayImage = this->ConvertToGray(colorImage);
-        Mat binaryImage(grayImage.size(), CV_8UC1);
+        // 灰階與二值化一次完成，不產生灰階圖
+        return image_kernel::ConvertBgrToBinary(colorImage, threshold, image_kernel::GrayWeights::Balanced);
+    }
 
-        for (int row = 0; row < binaryImage.rows; row++)
-            for (int col = 0; col < binaryImage.cols; col++)
-                binaryImage.at<uchar>(row, col) = grayImage.at<uchar>(row, col) > threshold ? 255 : 0;
-        return binaryImage;
+    // 二值化成 1 bit 一個像素
+    image_kernel::PackedBinary ImageLibrary::ConvertToPackedBinary(Mat colorImage, uchar threshold) {
+        return image_kernel::ConvertBgrToPackedBinary(colorImage, threshold, image_kernel::GrayWeights::Balanced);
+    }
+
+    // 二值化成 run-length
+    image_kernel::RunLengthBinary ImageLibrary::ConvertToRunLength(Mat colorImage, uchar threshold) {
+        return image_kernel::ConvertBgrToRunLength(colorImage, threshold, image_kernel::GrayWeights::Balanced, 0);
     }
 
-    // binaryImage  Labeling Image
+    // binaryImage 轉 Labeling Image
     Mat ImageLibrary::ConvertToLabeling(Mat binaryImage, Connected connected, int* objNumber, int sizeFilter){
-        // N uchar אּ int ñN 0 ܦ -1 () A 255 ܦ 0 (I)
-        Mat labels(binaryImage.size(), CV_32S);
-        for (int row = 0; row < binaryImage.rows; row++)
-            for (int col = 0; col < binaryImage.cols; col++) 
-                labels.at<int>(row, col) = binaryImage.at<uchar>(row, col) > 0 ? 0 : -1;
-
-        // labeling (Recursive Algorithm)
-        vector<Point> checkPoints = { Point(0, -1), Point(-1, 0), Point(0, 1), Point(1, 0) }; // 4-connected  checkPoint
-        vector<Point> eightConnected = { Point(-1, -1), Point(-1, 1), Point(1, -1), Point(1, 1) }; // 8-connected ݥ[J checkPoint
-        if (connected == Connected::Eight)
-            checkPoints.insert(checkPoints.end(), eightConnected.begin(), eightConnected.end());
-        auto InImage = [rows = labels.rows, cols = labels.cols](Point point) { // ˬd point yЬO_Xk
-            return point.x >= 0 && point.y >= 0 && point.x < rows && point.y < cols;
-        };
-        vector<int> objSize = { 0 }; // C object jp
-        int label = 0; // ƶq
-        for (int row = 0; row < labels.rows; row++)
-            for (int col = 0; col < labels.cols; col++) 
-                if (labels.at<int>(row, col) == -1) {
-                    labels.at<int>(row, col) = ++label;
-                    objSize.push_back(1);
-                    std::queue<Point> queue;
-                    queue.push(Point(row, col));
-                    while (!queue.empty()) {
-                        Point point = queue.front();
-                        queue.pop();
-                        for (Point checkPoint : checkPoints) {
-                            checkPoint.x += point.x;
-                            checkPoint.y += point.y;
-                            if (InImage(checkPoint) && labels.at<int>(checkPoint.x, checkPoint.y) == -1) {
-                                queue.push(checkPoint);
-                                labels.at<int>(checkPoint.x, checkPoint.y) = label;
-                                objSize[label]++;
-                            }
-                        }
-                    }
-                }
-
-        // CӪ
+        // 0 為物件、255 為背景，label 依物件第一個像素的掃描順序編號
+        vector<int> objSize; // 紀錄每個 object 的大小
+        Mat labels = this->ConvertToLabelMap(binaryImage, connected, &objSize);
+        return this->ColorizeLabelMap(labels, objSize, objNumber, sizeFilter);
+    }
+
+    // component tree 轉 Labeling Image
+    Mat ImageLibrary::ConvertToLabeling(const ComponentTree& tree, uchar threshold, int* objNumber, int sizeFilter) {
+        vector<int> objSize;
+        Mat labels = tree.LabelMap(threshold, &objSize);
+        return this->ColorizeLabelMap(labels, objSize, objNumber, sizeFilter);
+    }
+
+    // Label Map 填色
+    Mat ImageLibrary::ColorizeLabelMap(const Mat& labels, const std::vector<int>& objSize, int* objNumber, int sizeFilter) {
+        int label = (int)objSize.size() - 1; // 物件數量
+
+        // 為每個物件填色
         const int MAX_COLOR = 256 * 256 * 256;
-        Mat labelingImage(binaryImage.size(), CV_8UC3);
-        for (int row = 0; row < binaryImage.rows; row++)
-            for (int col = 0; col < binaryImage.cols; col++) {
-                int objLabel = labels.at<int>(row, col);
+        Mat labelingImage(labels.size(), CV_8UC3);
+        for (int row = 0; row < labels.rows; row++) {
+            const int* labelRow = labels.ptr<int>(row);
+            Vec3b* colorRow = labelingImage.ptr<Vec3b>(row);
+            for (int col = 0; col < labels.cols; col++) {
+                int objLabel = labelRow[col];
                 int color = objLabel * (MAX_COLOR / (label + 1));
-                labelingImage.at<Vec3b>(row, col) = objLabel > 0 && objSize[objLabel] > sizeFilter ? Vec3b((color >> 16) & 255, (color >> 8) & 255, color & 255) : Vec3b(0, 0, 0);
+                colorRow[col] = objLabel > 0 && objSize[objLabel] > sizeFilter ? Vec3b((color >> 16) & 255, (color >> 8) & 255, color & 255) : Vec3b(0, 0, 0);
             }
+        }
 
         // object number
         for (int objLabel = 1; objLabel < objSize.size(); objLabel++)
@@ -88,4 +78,50 @@ namespace image_model {
 
         return labelingImage;
     }
-}
\ No newline at end of file
+
+    // binaryImage 轉 Label Map
+    Mat ImageLibrary::ConvertToLabelMap(Mat binaryImage, Connected connected, std::vector<int>* objSizes) {
+        Mat labels;
+        vector<int> objSize;
+        ComponentLabeler((int)connected, _parallelLabeling).Label(binaryImage, labels, objSize);
+        if (objSizes != nullptr)
+            *objSizes = objSize;
+        return labels;
+    }
+
+    // run-length 轉 Label Map
+    Mat ImageLibrary::ConvertToLabelMap(const image_kernel::RunLengthBinary& runs, Connected connected, std::vector<int>* objSizes) {
+        vector<int> runLabels;
+        vector<int> objSize;
+        RunLabeler((int)connected).Label(runs, runLabels, objSize);
+        if (objSizes != nullptr)
+            *objSizes = objSize;
+        return RunLabeler::ToLabelMap(runs, runLabels);
+    }
+
+    // 逐列計算物件統計量
+    std::vector<ComponentStats> ImageLibrary::ComputeComponentStats(Mat binaryImage, Connected connected, int sizeFilter) {
+        CV_Assert(binaryImage.type() == CV_8UC1);
+        ComponentStatsAccumulator accumulator(binaryImage.cols, (int)connected);
+        for (int row = 0; row < binaryImage.rows; row++)
+            accumulator.PushRow(binaryImage.ptr<uchar>(row));
+
+        return FilterStats(accumulator, sizeFilter);
+    }
+
+    std::vector<ComponentStats> ImageLibrary::ComputeComponentStats(const image_kernel::PackedBinary& packedImage, Connected connected, int sizeFilter) {
+        ComponentStatsAccumulator accumulator(packedImage.Cols(), (int)connected);
+        vector<uchar> binaryRow(packedImage.Cols());
+        for (int row = 0; row < packedImage.Rows(); row++) {
+            packedImage.UnpackRow(row, binaryRow.data());
+            accumulator.PushRow(binaryRow.data());
+        }
+
+        return FilterStats(accumulator, sizeFilter);
+    }
+
+    // 灰階的 component tree，灰階與二值化使用相同權重
+    ComponentTree ImageLibrary::BuildComponentTree(Mat colorImage, Connected connected) {
+        return ComponentTree(this->ConvertToGray(colorImage), (int)connected);
+    }
+}
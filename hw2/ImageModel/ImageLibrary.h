@@ -1,5 +1,8 @@
 #pragma once
 #include <opencv2/opencv.hpp>
+#include "../../Common/BinaryKernel.h"
+#include "Labeling.h"
+#include "ComponentTree.h"
 
 using namespace cv;
 
@@ -9,21 +12,44 @@ namespace image_model {
     public:
         ImageLibrary() {};
 
-        // sq 4-connected 8-connected
+        // labeling 是否使用多執行緒 (結果與單執行緒相同)
+        void SetParallelLabeling(bool parallel) { _parallelLabeling = parallel; }
+
+        // 連通數 4-connected 8-connected
         enum class Connected
         {
             Four = 4,
             Eight = 8
         };
 
-        // Ƕ
+        // 轉灰階
         Mat ConvertToGray(Mat colorImage);
-        // GȤ
+        // 二值化
         Mat ConvertToBinary(Mat colorImage, uchar threshold = 128);
-        // Labeling ImageAconnected: sqơAobjNumber: gJ label ƶqAsizeFilter: Size Filtering
+        // 二值化成 1 bit 一個像素
+        image_kernel::PackedBinary ConvertToPackedBinary(Mat colorImage, uchar threshold = 128);
+        // 二值化成 run-length，run 為物件 (二值化後為 0 的像素)
+        image_kernel::RunLengthBinary ConvertToRunLength(Mat colorImage, uchar threshold = 128);
+        // Labeling Image，connected: 連通數，objNumber: 寫入 label 的物件數量，sizeFilter: Size Filtering
         Mat ConvertToLabeling(Mat binaryImage, Connected connected = Connected::Four, int* objNumber = nullptr, int sizeFilter = -1);
+        // 由 component tree 取出門檻值 threshold 的 Labeling Image，結果與先二值化再 labeling 相同
+        Mat ConvertToLabeling(const ComponentTree& tree, uchar threshold, int* objNumber = nullptr, int sizeFilter = -1);
+        // Label Map (CV_32S)，背景為 0、物件依掃描順序編號 1 ~ N，objSizes: 寫入各 label 的物件大小
+        Mat ConvertToLabelMap(Mat binaryImage, Connected connected = Connected::Four, std::vector<int>* objSizes = nullptr);
+        // 以 run 為單位 labeling，結果與 CV_8UC1 版本相同
+        Mat ConvertToLabelMap(const image_kernel::RunLengthBinary& runs, Connected connected = Connected::Four, std::vector<int>* objSizes = nullptr);
+        // 物件統計量 (面積、外框、重心、周長)，只保留面積大於 sizeFilter 的物件，依掃描順序排列
+        // 逐列處理，不產生 label map
+        std::vector<ComponentStats> ComputeComponentStats(Mat binaryImage, Connected connected = Connected::Four, int sizeFilter = -1);
+        // 1 bit 二值圖 (1 為背景) 的物件統計量，逐列展開
+        std::vector<ComponentStats> ComputeComponentStats(const image_kernel::PackedBinary& packedImage, Connected connected = Connected::Four, int sizeFilter = -1);
+        // 灰階的 component tree，可查詢所有門檻值的物件數 (CountObjects) 與任一門檻值的 label map
+        ComponentTree BuildComponentTree(Mat colorImage, Connected connected = Connected::Four);
 
     private:
+        bool _parallelLabeling = false;
 
+        // Label Map 填色，objNumber: 寫入面積大於 sizeFilter 的物件數量
+        Mat ColorizeLabelMap(const Mat& labels, const std::vector<int>& objSize, int* objNumber, int sizeFilter);
     };
 }
@@ -0,0 +1,259 @@
+﻿#include "Labeling.h"
+#include "../../Common/ThreadPool.h"
+
+namespace image_model {
+    namespace {
+        // 水平條帶的暫時 label 與等價關係
+        struct Stripe
+        {
+            int rowBegin;
+            int rowEnd;
+            UnionFind unionFind;    // index 0 為背景
+            std::vector<int> sizes; // 各暫時 label 的像素數
+            int offset;             // 全域 index = offset + 暫時 label
+        };
+
+        // 第一次掃描的一列，previous 為 nullptr 時不看上一列，新的暫時 label 由 unionFind 配置
+        // 鄰居以 decision tree 檢查: a 左上、b 上、c 右上、d 左
+        void ScanRow(const uchar* pixels, const int* previous, int* current, int cols, int connectivity, UnionFind& unionFind) {
+            for (int col = 0; col < cols; col++) {
+                if (pixels[col] != 0) {
+                    current[col] = 0;
+                    continue;
+                }
+
+                const int a = previous && col > 0 ? previous[col - 1] : 0;
+                const int b = previous ? previous[col] : 0;
+                const int c = previous && col + 1 < cols ? previous[col + 1] : 0;
+                const int d = col > 0 ? current[col - 1] : 0;
+
+                int label;
+                if (connectivity == 8) {
+                    if (b)
+                        label = b;
+                    else if (c) {
+                        if (a)
+                            label = unionFind.Union(c, a);
+                        else if (d)
+                            label = unionFind.Union(c, d);
+                        else
+                            label = c;
+                    }
+                    else if (a)
+                        label = a;
+                    else if (d)
+                        label = d;
+                    else
+                        label = unionFind.Add();
+                }
+                else {
+                    if (b)
+                        label = d ? unionFind.Union(b, d) : b;
+                    else if (d)
+                        label = d;
+                    else
+                        label = unionFind.Add();
+                }
+                current[col] = label;
+            }
+        }
+
+        // 第一次掃描 [rowBegin, rowEnd)，條帶第一列不看上一列 (由合併階段處理)
+        void ScanStripe(const Mat& binaryImage, Mat& labels, int connectivity, Stripe& stripe) {
+            const int cols = binaryImage.cols;
+            stripe.unionFind.Add();
+            for (int row = stripe.rowBegin; row < stripe.rowEnd; row++) {
+                int* current = labels.ptr<int>(row);
+                const int* previous = row > stripe.rowBegin ? labels.ptr<int>(row - 1) : nullptr;
+                ScanRow(binaryImage.ptr<uchar>(row), previous, current, cols, connectivity, stripe.unionFind);
+                stripe.sizes.resize(stripe.unionFind.Size(), 0);
+                for (int col = 0; col < cols; col++)
+                    stripe.sizes[current[col]]++;
+            }
+        }
+    }
+
+    int ComponentLabeler::Label(const Mat& binaryImage, Mat& labels, std::vector<int>& objSizes) const {
+        CV_Assert(binaryImage.type() == CV_8UC1);
+        const int rows = binaryImage.rows;
+        const int cols = binaryImage.cols;
+        labels.create(binaryImage.size(), CV_32S);
+
+        // 切成水平條帶，平行模式下每個執行緒約分到 4 個條帶
+        int stripeRows = rows;
+        if (_parallel) {
+            const int threadCount = image_kernel::ThreadPool::Instance().ThreadCount();
+            stripeRows = std::max(MIN_STRIPE_ROWS, (rows + threadCount * 4 - 1) / (threadCount * 4));
+        }
+        std::vector<Stripe> stripes;
+        for (int row = 0; row < rows; row += stripeRows) {
+            stripes.emplace_back();
+            stripes.back().rowBegin = row;
+            stripes.back().rowEnd = std::min(row + stripeRows, rows);
+        }
+
+        // 第一次掃描: 各條帶獨立進行
+        image_kernel::ParallelFor(0, (int)stripes.size(), 1, [&](int begin, int end) {
+            for (int s = begin; s < end; s++)
+                ScanStripe(binaryImage, labels, _connectivity, stripes[s]);
+        });
+
+        // 合併: 依條帶順序建立全域 union-find，全域 index 順序即為暫時 label 的掃描順序
+        // 每個物件的第一個像素必定產生新的 label 且 index 最小，重新編號後與逐列掃描的結果相同
+        UnionFind unionFind;
+        unionFind.Add();
+        for (Stripe& stripe : stripes) {
+            stripe.offset = unionFind.Size() - 1;
+            for (int local = 1; local < stripe.unionFind.Size(); local++) {
+                int global = unionFind.Add();
+                int root = stripe.unionFind.Find(local);
+                if (root != local)
+                    unionFind.Union(global, stripe.offset + root);
+            }
+        }
+        for (int s = 1; s < (int)stripes.size(); s++) {
+            const int* previous = labels.ptr<int>(stripes[s].rowBegin - 1);
+            const int* current = labels.ptr<int>(stripes[s].rowBegin);
+            const int previousOffset = stripes[s - 1].offset;
+            const int currentOffset = stripes[s].offset;
+            for (int col = 0; col < cols; col++) {
+                if (!current[col])
+                    continue;
+                const int global = currentOffset + current[col];
+                if (previous[col])
+                    unionFind.Union(global, previousOffset + previous[col]);
+                if (_connectivity == 8) {
+                    if (col > 0 && previous[col - 1])
+                        unionFind.Union(global, previousOffset + previous[col - 1]);
+                    if (col + 1 < cols && previous[col + 1])
+                        unionFind.Union(global, previousOffset + previous[col + 1]);
+                }
+            }
+        }
+
+        std::vector<int> finalLabels;
+        int objCount = unionFind.Flatten(finalLabels, 0) - 1; // 扣掉背景
+        objSizes.assign(objCount + 1, 0);
+        for (const Stripe& stripe : stripes)
+            for (int local = 1; local < (int)stripe.sizes.size(); local++)
+                objSizes[finalLabels[stripe.offset + local]] += stripe.sizes[local];
+
+        // 第二次掃描: 寫入最終 label
+        image_kernel::ParallelFor(0, (int)stripes.size(), 1, [&](int begin, int end) {
+            for (int s = begin; s < end; s++) {
+                const int* stripeLabels = finalLabels.data() + stripes[s].offset;
+                for (int row = stripes[s].rowBegin; row < stripes[s].rowEnd; row++) {
+                    int* current = labels.ptr<int>(row);
+                    for (int col = 0; col < cols; col++)
+                        if (current[col])
+                            current[col] = stripeLabels[current[col]];
+                }
+            }
+        });
+        return objCount;
+    }
+
+    ComponentStatsAccumulator::ComponentStatsAccumulator(int cols, int connectivity) {
+        this->_cols = cols;
+        this->_connectivity = connectivity;
+        this->_rows = 0;
+        this->_previous.assign(cols, 0);
+        this->_current.assign(cols, 0);
+        this->_unionFind.Add();
+        this->_stats.emplace_back();
+    }
+
+    void ComponentStatsAccumulator::PushRow(const uchar* binaryRow) {
+        const int row = _rows++;
+        ScanRow(binaryRow, row > 0 ? _previous.data() : nullptr, _current.data(), _cols, _connectivity, _unionFind);
+        _stats.resize(_unionFind.Size());
+
+        const int* previous = _previous.data();
+        const int* current = _current.data();
+        for (int col = 0; col < _cols; col++) {
+            const int label = current[col];
+            if (!label) {
+                // 上方物件的下緣
+                if (previous[col])
+                    _stats[previous[col]].perimeter++;
+                continue;
+            }
+            ComponentStats& stats = _stats[label];
+            stats.AddPixel(col, row);
+            // 左、右、上三個方向，下方由下一列或 Finish 處理
+            stats.perimeter += (col == 0 || !current[col - 1]) + (col + 1 == _cols || !current[col + 1]) + !previous[col];
+        }
+        std::swap(_previous, _current);
+    }
+
+    int ComponentStatsAccumulator::Finish(std::vector<ComponentStats>& stats) {
+        // 最後一列的下緣
+        for (int col = 0; col < _cols; col++)
+            if (_previous[col])
+                _stats[_previous[col]].perimeter++;
+        std::fill(_previous.begin(), _previous.end(), 0);
+
+        std::vector<int> finalLabels;
+        int objCount = _unionFind.Flatten(finalLabels, 0) - 1; // 扣掉背景
+        stats.assign(objCount + 1, ComponentStats());
+        for (int label = 1; label < (int)_stats.size(); label++)
+            stats[finalLabels[label]].Merge(_stats[label]);
+        return objCount;
+    }
+
+    int RunLabeler::Label(const image_kernel::RunLengthBinary& runs, std::vector<int>& runLabels, std::vector<int>& objSizes) const {
+        typedef image_kernel::RunLengthBinary::Run Run;
+        // 8-connected 時 run 向左右各延伸一格再判斷重疊
+        const int reach = _connectivity == 8 ? 1 : 0;
+
+        // index 0 為背景，第 i 個 run 為 i + 1，run 依掃描順序排列，根節點即為物件的第一個 run
+        UnionFind unionFind;
+        unionFind.Reserve(runs.RunCount() + 1);
+        unionFind.Add();
+        for (int row = 0; row < runs.Rows(); row++) {
+            const Run* current = runs.RowBegin(row);
+            const Run* currentEnd = runs.RowEnd(row);
+            const int currentFirst = runs.RowFirstRun(row) + 1;
+            for (const Run* run = current; run != currentEnd; run++)
+                unionFind.Add();
+            if (row == 0)
+                continue;
+
+            // 兩列的 run 皆由左至右排列，以兩個指標合併
+            const Run* previous = runs.RowBegin(row - 1);
+            const Run* previousEnd = runs.RowEnd(row - 1);
+            const int previousFirst = runs.RowFirstRun(row - 1) + 1;
+            const Run* above = previous;
+            for (const Run* run = current; run != currentEnd; run++) {
+                // 跳過完全在左邊的 run
+                while (above != previousEnd && above->end + reach <= run->start)
+                    above++;
+                for (const Run* overlap = above; overlap != previousEnd && overlap->start < run->end + reach; overlap++)
+                    unionFind.Union(currentFirst + (int)(run - current), previousFirst + (int)(overlap - previous));
+            }
+        }
+
+        std::vector<int> finalLabels;
+        int objCount = unionFind.Flatten(finalLabels, 0) - 1; // 扣掉背景
+        runLabels.resize(runs.RunCount());
+        objSizes.assign(objCount + 1, 0);
+        for (int index = 0; index < runs.RunCount(); index++) {
+            const Run& run = runs.At(index);
+            runLabels[index] = finalLabels[index + 1];
+            objSizes[runLabels[index]] += run.end - run.start;
+        }
+        return objCount;
+    }
+
+    Mat RunLabeler::ToLabelMap(const image_kernel::RunLengthBinary& runs, const std::vector<int>& runLabels) {
+        Mat labels(runs.Rows(), runs.Cols(), CV_32S, Scalar(0));
+        for (int row = 0; row < runs.Rows(); row++) {
+            int* labelRow = labels.ptr<int>(row);
+            for (int index = runs.RowFirstRun(row); index < runs.RowFirstRun(row + 1); index++) {
+                const image_kernel::RunLengthBinary::Run& run = runs.At(index);
+                std::fill(labelRow + run.start, labelRow + run.end, runLabels[index]);
+            }
+        }
+        return labels;
+    }
+}
@@ -0,0 +1,180 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include "../../Common/RunLength.h"
+
+using namespace cv;
+
+namespace image_model {
+    // 陣列實作的 union-find，根節點固定為集合中最小的 index
+    class UnionFind
+    {
+    public:
+        UnionFind() {}
+
+        void Reserve(int size) {
+            _parent.reserve(size);
+        }
+
+        // 新增一個集合並回傳其 index
+        int Add() {
+            _parent.push_back((int)_parent.size());
+            return (int)_parent.size() - 1;
+        }
+
+        int Size() const {
+            return (int)_parent.size();
+        }
+
+        int Find(int x) {
+            int root = x;
+            while (_parent[root] != root)
+                root = _parent[root];
+            // 路徑壓縮
+            while (_parent[x] != root) {
+                int next = _parent[x];
+                _parent[x] = root;
+                x = next;
+            }
+            return root;
+        }
+
+        // 合併兩個集合，回傳新的根節點 (較小的 index)
+        int Union(int x, int y) {
+            x = this->Find(x);
+            y = this->Find(y);
+            if (x == y)
+                return x;
+            if (x < y) {
+                _parent[y] = x;
+                return x;
+            }
+            _parent[x] = y;
+            return y;
+        }
+
+        // 依根節點出現順序重新編號 (從 firstLabel 開始)，回傳集合數
+        // 因根節點為最小 index，依 index 順序處理即可
+        int Flatten(std::vector<int>& labels, int firstLabel = 1) {
+            labels.resize(_parent.size());
+            int count = 0;
+            for (int i = 0; i < (int)_parent.size(); i++)
+                labels[i] = _parent[i] == i ? firstLabel + count++ : labels[_parent[i]];
+            return count;
+        }
+
+    private:
+        std::vector<int> _parent;
+    };
+
+    // Connected component labeling，兩次掃描 + union-find
+    // 第一次掃描以 decision tree 檢查已掃描的鄰居並記錄等價關係，第二次掃描寫入最終 label
+    // 平行模式將圖片切成水平條帶各自掃描，再合併條帶交界的等價關係，結果與單執行緒相同
+    class ComponentLabeler
+    {
+    public:
+        // connectivity: 4 或 8，parallel: 使用共用 thread pool
+        ComponentLabeler(int connectivity = 4, bool parallel = false) {
+            this->_connectivity = connectivity;
+            this->_parallel = parallel;
+        }
+
+        // binaryImage 中值為 0 的像素為物件
+        // labels: CV_32S，背景為 0，物件依第一個像素的掃描順序編號為 1 ~ N
+        // objSizes: 各物件像素數，objSizes[0] 不使用
+        // 回傳物件數 N
+        int Label(const Mat& binaryImage, Mat& labels, std::vector<int>& objSizes) const;
+
+    private:
+        static const int MIN_STRIPE_ROWS = 32; // 條帶最少列數
+
+        int _connectivity;
+        bool _parallel;
+    };
+
+    // 物件統計量，x 為 col、y 為 row
+    struct ComponentStats
+    {
+        int area = 0;
+        int left = INT_MAX, top = INT_MAX, right = -1, bottom = -1; // 外框 (含邊界)
+        long long sumX = 0, sumY = 0;
+        int perimeter = 0; // 與背景或圖片邊界相鄰的像素邊數 (上下左右)
+
+        Rect BoundingBox() const {
+            return Rect(left, top, right - left + 1, bottom - top + 1);
+        }
+
+        Point2d Centroid() const {
+            return Point2d((double)sumX / area, (double)sumY / area);
+        }
+
+        void AddPixel(int x, int y) {
+            area++;
+            left = std::min(left, x);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y);
+            sumX += x;
+            sumY += y;
+        }
+
+        void Merge(const ComponentStats& other) {
+            area += other.area;
+            left = std::min(left, other.left);
+            right = std::max(right, other.right);
+            top = std::min(top, other.top);
+            bottom = std::max(bottom, other.bottom);
+            sumX += other.sumX;
+            sumY += other.sumY;
+            perimeter += other.perimeter;
+        }
+    };
+
+    // 逐列輸入二值圖並計算各物件統計量，只保留兩列 label，不產生完整的 label map
+    // 物件編號與 ComponentLabeler 相同
+    class ComponentStatsAccumulator
+    {
+    public:
+        // cols: 每列像素數，connectivity: 4 或 8
+        ComponentStatsAccumulator(int cols, int connectivity = 4);
+
+        // 依序輸入一列，值為 0 的像素為物件
+        void PushRow(const uchar* binaryRow);
+
+        // 結束輸入，stats[1 ~ N] 為各物件統計量 (stats[0] 不使用)，回傳物件數 N
+        int Finish(std::vector<ComponentStats>& stats);
+
+    private:
+        int _cols;
+        int _connectivity;
+        int _rows;
+        std::vector<int> _previous;         // 上一列的暫時 label
+        std::vector<int> _current;
+        UnionFind _unionFind;
+        std::vector<ComponentStats> _stats; // 各暫時 label 的統計量
+    };
+
+    // 以 run 為單位的 labeling，相鄰兩列中重疊的 run 合併 (8-connected 時斜角相接也算)
+    // 成本與 run 數成正比，編號與 ComponentLabeler 相同
+    class RunLabeler
+    {
+    public:
+        // connectivity: 4 或 8
+        RunLabeler(int connectivity = 4) {
+            this->_connectivity = connectivity;
+        }
+
+        // runs 中的 run 為物件
+        // runLabels: 各 run 的 label (1 ~ N)，objSizes: 各物件像素數，objSizes[0] 不使用
+        // 回傳物件數 N
+        int Label(const image_kernel::RunLengthBinary& runs, std::vector<int>& runLabels, std::vector<int>& objSizes) const;
+
+        // 依 run label 畫出 label map (CV_32S，背景為 0)
+        static Mat ToLabelMap(const image_kernel::RunLengthBinary& runs, const std::vector<int>& runLabels);
+
+    private:
+        int _connectivity;
+    };
+}
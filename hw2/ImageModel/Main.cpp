@@ -14,7 +14,7 @@ int main() {
         "4",
     };
 
-    // threshold ]w
+    // threshold 設定
     const int THRESHOLD_SETTRING[] = {
         128,
         210,
@@ -25,6 +25,7 @@ int main() {
     const string IMAGE_PATH_FORMAT = "..\\image\\%s.png";
 
     ImageLibrary library = ImageLibrary();
+    library.SetParallelLabeling(true);
 
     for (int i = 0; i < 4; i++)
     {
@@ -1,27 +1,271 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <opencv2/opencv.hpp>
+#include "../../Common/BinaryKernel.h"
+#include "../../Common/GrayKernel.h"
+#include "../../Common/ThreadPool.h"
 
 using namespace std;
 using namespace cv;
 
+// 判斷區域內顏色是否多於一種
+// 預先計算每個像素與左方、上方像素顏色是否不同的積分圖，區域內沒有相鄰的相異像素即只有一種顏色
+// 建表一次掃描整張圖，之後每次查詢為 O(1)，parallel 時各列平行累加後再平行累加各行
+// image: CV_8UC1 (如二值圖，不需轉為 3 通道) 或 CV_8UC3
+class ColorChangeTable
+{
+private:
+    Mat _image;
+    int _rows;
+    int _cols;
+    vector<int> _horizontal;    // 與左方像素不同的個數 (積分圖，(rows + 1) x (cols + 1))
+    vector<int> _vertical;      // 與上方像素不同的個數
+
+    // [row0, row1) x [col0, col1) 的總和
+    int Sum(const vector<int>& integral, int row0, int row1, int col0, int col1) const {
+        const int stride = _cols + 1;
+        return integral[row1 * stride + col1] - integral[row0 * stride + col1] - integral[row1 * stride + col0] + integral[row0 * stride + col0];
+    }
+
+    // 以 Pixel (uchar 或 Vec3b) 讀取像素建表
+    template <typename Pixel>
+    void Build(const Mat& image, bool parallel) {
+        const int stride = _cols + 1;
+        _horizontal.assign((size_t)(_rows + 1) * stride, 0);
+        _vertical.assign((size_t)(_rows + 1) * stride, 0);
+        if (!parallel) {
+            for (int i = 0; i < _rows; i++) {
+                const Pixel* row = image.ptr<Pixel>(i);
+                const Pixel* upRow = i > 0 ? image.ptr<Pixel>(i - 1) : nullptr;
+                int horizontalSum = 0, verticalSum = 0;
+                for (int j = 0; j < _cols; j++) {
+                    horizontalSum += j > 0 && row[j] != row[j - 1];
+                    verticalSum += upRow && row[j] != upRow[j];
+                    _horizontal[(i + 1) * stride + j + 1] = _horizontal[i * stride + j + 1] + horizontalSum;
+                    _vertical[(i + 1) * stride + j + 1] = _vertical[i * stride + j + 1] + verticalSum;
+                }
+            }
+            return;
+        }
+
+        // 各列的前綴和
+        image_kernel::ParallelFor(0, _rows, 16, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Pixel* row = image.ptr<Pixel>(i);
+                const Pixel* upRow = i > 0 ? image.ptr<Pixel>(i - 1) : nullptr;
+                int* horizontal = &_horizontal[(i + 1) * stride];
+                int* vertical = &_vertical[(i + 1) * stride];
+                for (int j = 0; j < _cols; j++) {
+                    horizontal[j + 1] = horizontal[j] + (j > 0 && row[j] != row[j - 1]);
+                    vertical[j + 1] = vertical[j] + (upRow && row[j] != upRow[j]);
+                }
+            }
+        });
+        // 由上往下累加，各行區段互不相關
+        image_kernel::ParallelFor(1, stride, 256, [&](int begin, int end) {
+            for (int i = 1; i < _rows; i++) {
+                for (int j = begin; j < end; j++) {
+                    _horizontal[(i + 1) * stride + j] += _horizontal[i * stride + j];
+                    _vertical[(i + 1) * stride + j] += _vertical[i * stride + j];
+                }
+            }
+        });
+    }
+
+public:
+    ColorChangeTable(const Mat& image, bool parallel = false) {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        _image = image;
+        _rows = image.rows;
+        _cols = image.cols;
+        if (image.channels() == 1)
+            this->Build<uchar>(image, parallel);
+        else
+            this->Build<Vec3b>(image, parallel);
+    }
+
+    // 像素顏色 (rect 的座標方向)，CV_8UC1 時三個通道相同
+    Vec3b ColorAt(int row, int col) const {
+        if (_image.channels() == 1) {
+            const uchar value = _image.at<uchar>(row, col);
+            return Vec3b(value, value, value);
+        }
+        return _image.at<Vec3b>(row, col);
+    }
+
+    // rect 與 QuadtreeNode 相同: x、width 為列方向，y、height 為行方向
+    bool HasMultipleColors(const Rect& rect) const {
+        if (rect.width <= 0 || rect.height <= 0)
+            return false;
+        const int row0 = rect.x, row1 = rect.x + rect.width;
+        const int col0 = rect.y, col1 = rect.y + rect.height;
+        return Sum(_horizontal, row0, row1, col0 + 1, col1) > 0 || Sum(_vertical, row0 + 1, row1, col0, col1) > 0;
+    }
+
+    // 分裂條件: 只有一種顏色時不分裂，color 為該顏色
+    bool IsUniform(const Rect& rect, Vec3b& color) const {
+        if (HasMultipleColors(rect))
+            return false;
+        color = this->ColorAt(rect.x, rect.y);
+        return true;
+    }
+};
+
+// 區域的像素數、各通道總和與平方和
+struct RegionStats
+{
+    double count = 0;
+    double sum[3] = { 0, 0, 0 };
+    double squareSum[3] = { 0, 0, 0 };
+
+    void Merge(const RegionStats& other) {
+        count += other.count;
+        for (int c = 0; c < 3; c++) {
+            sum[c] += other.sum[c];
+            squareSum[c] += other.squareSum[c];
+        }
+    }
+
+    // 各通道標準差皆不大於 tolerance
+    bool WithinTolerance(double tolerance) const {
+        for (int c = 0; c < 3; c++)
+            if (squareSum[c] * count - sum[c] * sum[c] > tolerance * tolerance * count * count)
+                return false;
+        return true;
+    }
+
+    Vec3b Mean() const {
+        return Vec3b(saturate_cast<uchar>(sum[0] / count), saturate_cast<uchar>(sum[1] / count), saturate_cast<uchar>(sum[2] / count));
+    }
+};
+
+// 各通道總和與平方和的積分圖，O(1) 取得任意區域的平均與變異數 (灰階圖三個通道相同)
+// 總和與平方和皆以 64 bit 儲存，超過 1600 萬像素 (255 x 面積 >= 2^32) 的區域總和也不會溢位
+class ColorStatsTable
+{
+private:
+    double _tolerance;
+    int _rows;
+    int _cols;
+    int _channels;
+    vector<uint64_t> _sum;          // (rows + 1) x (cols + 1) x channels
+    vector<uint64_t> _squareSum;
+
+    size_t IndexOf(int row, int col) const {
+        return ((size_t)row * (_cols + 1) + col) * _channels;
+    }
+
+public:
+    // image: CV_8UC1 或 CV_8UC3，tolerance: 區域內各通道標準差上限
+    ColorStatsTable(const Mat& image, double tolerance, bool parallel = false) {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        _tolerance = tolerance;
+        _rows = image.rows;
+        _cols = image.cols;
+        _channels = image.channels();
+        _sum.assign(IndexOf(_rows + 1, 0), 0);
+        _squareSum.assign(IndexOf(_rows + 1, 0), 0);
+
+        // 各列的前綴和
+        image_kernel::ParallelFor(0, _rows, parallel ? 16 : _rows, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const uchar* row = image.ptr<uchar>(i);
+                uint64_t* sum = &_sum[IndexOf(i + 1, 0)];
+                uint64_t* squareSum = &_squareSum[IndexOf(i + 1, 0)];
+                for (int j = 0; j < _cols * _channels; j++) {
+                    sum[j + _channels] = sum[j] + row[j];
+                    squareSum[j + _channels] = squareSum[j] + (uint64_t)row[j] * row[j];
+                }
+            }
+        });
+        // 由上往下累加
+        const int width = (_cols + 1) * _channels;
+        image_kernel::ParallelFor(0, width, parallel ? 256 : width, [&](int begin, int end) {
+            for (int i = 1; i < _rows; i++) {
+                for (int j = begin; j < end; j++) {
+                    _sum[IndexOf(i + 1, 0) + j] += _sum[IndexOf(i, 0) + j];
+                    _squareSum[IndexOf(i + 1, 0) + j] += _squareSum[IndexOf(i, 0) + j];
+                }
+            }
+        });
+    }
+
+    // rect 與 QuadtreeNode 相同: x、width 為列方向，y、height 為行方向
+    RegionStats StatsOf(const Rect& rect) const {
+        RegionStats stats;
+        if (rect.width <= 0 || rect.height <= 0)
+            return stats;
+        const size_t a = IndexOf(rect.x, rect.y), b = IndexOf(rect.x, rect.y + rect.height);
+        const size_t c = IndexOf(rect.x + rect.width, rect.y), d = IndexOf(rect.x + rect.width, rect.y + rect.height);
+        stats.count = (double)rect.width * rect.height;
+        for (int k = 0; k < 3; k++) {
+            const int channel = _channels == 1 ? 0 : k;
+            stats.sum[k] = (double)(_sum[d + channel] - _sum[b + channel] - _sum[c + channel] + _sum[a + channel]);
+            stats.squareSum[k] = (double)(_squareSum[d + channel] - _squareSum[b + channel] - _squareSum[c + channel] + _squareSum[a + channel]);
+        }
+        return stats;
+    }
+
+    // 分裂條件: 各通道標準差不大於容許值時不分裂，color 為平均顏色
+    bool IsUniform(const Rect& rect, Vec3b& color) const {
+        RegionStats stats = StatsOf(rect);
+        if (stats.count == 0) {
+            color = Vec3b(128, 128, 128);
+            return true;
+        }
+        if (!stats.WithinTolerance(_tolerance))
+            return false;
+        color = stats.Mean();
+        return true;
+    }
+};
+
 class QuadtreeNode
 {
 private:
-    Rect _rect;                     // `Id
-    int _level;                     // `Ih
-    bool _isLeaf;                   // O`I
-    Vec3b _color;                   // `IC
-    QuadtreeNode* _childrens[4];    // l`I
-
-    // ˬdCƶqO_h@
-    bool CheakColor(const Mat& image) {
-        for (int i = _rect.x; i < _rect.x + _rect.width; i++) 
-            for (int j = _rect.y; j < _rect.y + _rect.height; j++) 
-                if (image.at<Vec3b>(i, j)[0] != image.at<Vec3b>(_rect.x, _rect.y)[0] ||
-                    image.at<Vec3b>(i, j)[1] != image.at<Vec3b>(_rect.x, _rect.y)[1] ||
-                    image.at<Vec3b>(i, j)[2] != image.at<Vec3b>(_rect.x, _rect.y)[2])
-                    return true;
-        return false;
+    Rect _rect;                     // 節點範圍
+    int _level;                     // 節點層數
+    bool _isLeaf;                   // 是葉節點
+    Vec3b _color;                   // 節點顏色
+    QuadtreeNode* _childrens[4];    // 子節點
+
+    // 分裂節點，以查表判斷顏色數量
+    void SplitNode(const Mat& image, const ColorChangeTable& colorChange, int maxLevel) {
+        // 多於一種顏色繼續分裂
+        if (colorChange.HasMultipleColors(_rect)) {
+            _isLeaf = false;
+
+            int halfWidth = _rect.width / 2;
+            int halfHeight = _rect.height / 2;
+
+            _childrens[0] = new QuadtreeNode(Rect(_rect.x, _rect.y, halfWidth, halfHeight), _level + 1);
+            _childrens[1] = new QuadtreeNode(Rect(_rect.x + halfWidth, _rect.y, halfWidth, halfHeight), _level + 1);
+            _childrens[2] = new QuadtreeNode(Rect(_rect.x, _rect.y + halfHeight, halfWidth, halfHeight), _level + 1);
+            _childrens[3] = new QuadtreeNode(Rect(_rect.x + halfWidth, _rect.y + halfHeight, halfWidth, halfHeight), _level + 1);
+
+            // 超過最大上限的子節點不分裂，維持預設顏色
+            if (_level + 1 <= maxLevel)
+                for (int i = 0; i < 4; i++)
+                    _childrens[i]->SplitNode(image, colorChange, maxLevel);
+        }
+        else // 只有一種顏色
+            _color = colorChange.ColorAt(_rect.x, _rect.y);
     }
 
 public:
@@ -41,37 +285,19 @@ public:
                 delete this->_childrens[i];
     }
     
-    // `I
+    // 分裂節點
     bool SplitNode(const Mat& image, int maxLevel = INT_MAX) {
-        // O`IιF̤jW
+        // 不是葉節點或達到最大上限不分裂
         if (_level > maxLevel || !_isLeaf)
             return false;
 
-        bool continueSplit = false;
-
-        // h@C~
-        if (CheakColor(image)) {
-            continueSplit = true;
-            _isLeaf = false;
-
-            int halfWidth = _rect.width / 2;
-            int halfHeight = _rect.height / 2;
-
-            _childrens[0] = new QuadtreeNode(Rect(_rect.x, _rect.y, halfWidth, halfHeight), _level + 1);
-            _childrens[1] = new QuadtreeNode(Rect(_rect.x + halfWidth, _rect.y, halfWidth, halfHeight), _level + 1);
-            _childrens[2] = new QuadtreeNode(Rect(_rect.x, _rect.y + halfHeight, halfWidth, halfHeight), _level + 1);
-            _childrens[3] = new QuadtreeNode(Rect(_rect.x + halfWidth, _rect.y + halfHeight, halfWidth, halfHeight), _level + 1);
-
-            for (int i = 0; i < 4; i++) 
-                _childrens[i]->SplitNode(image, maxLevel);
-        }
-        else // u@C
-            _color = image.at<Vec3b>(_rect.x, _rect.y);
-        
-        return continueSplit;
+        // 整張圖建表一次，各節點不再重複掃描
+        ColorChangeTable colorChange(image);
+        SplitNode(image, colorChange, maxLevel);
+        return !_isLeaf;
     }
 
-    // N node øs image
+    // 將 node 繪製到 image
     void DrawNode(Mat& image, int maxLevel = INT_MAX) {
         if (this->_isLeaf || this->_level >= maxLevel) {
             for (int i = _rect.x; i < _rect.x + _rect.width; i++)
@@ -86,6 +312,864 @@ public:
 };
 
 
+// 線性 quadtree: 不存節點指標，只以深度優先 (Morton) 順序存放葉節點的路徑碼、層數與顏色
+// 路徑碼每層 2 bit (0 左上、1 x 方向後半、2 y 方向後半、3 兩者皆後半)，由最高位往下排列
+// 節點範圍由根節點範圍與路徑碼推算，整棵樹只佔一個連續陣列
+// 平行模式將面積大於 grain 的節點往下展開成多個子樹工作，各自建立葉節點後依序串接，結果與單執行緒相同
+class LinearQuadtree
+{
+public:
+    struct Leaf
+    {
+        uint64_t code;  // 路徑碼
+        uchar level;    // 層數
+        Vec3b color;    // 顏色
+    };
+
+    static const int MAX_LEVEL = 32;    // 路徑碼可表示的層數
+    static const int DRAW_GRAIN = 1024; // 平行繪製時每個工作的葉節點數
+
+private:
+    // 平行分裂的子樹工作
+    struct SplitTask
+    {
+        uint64_t code;
+        int level;
+        Rect rect;
+        vector<Leaf> leaves;
+    };
+
+    // 多層繪製時與上一層不同的區塊
+    struct LayerPatch
+    {
+        Rect rect;
+        Vec3b color;
+    };
+
+    Rect _rect;             // 根節點範圍 (與 QuadtreeNode 相同，x、width 為列方向)
+    vector<Leaf> _leaves;   // 葉節點，依路徑碼排序
+    int _parallelGrain = 0; // 平行分裂時子樹工作的最大面積，0 為單執行緒
+
+    static Vec3b DefaultColor() {
+        return Vec3b(128, 128, 128);
+    }
+
+    // 第 level 層的路徑碼位移
+    static int ShiftOf(int level) {
+        return 2 * (MAX_LEVEL - 1 - level);
+    }
+
+    // 保留前 level 層路徑的遮罩
+    static uint64_t AncestorMask(int level) {
+        return level <= 0 ? 0 : level >= MAX_LEVEL ? ~0ULL : ~0ULL << (2 * (MAX_LEVEL - level));
+    }
+
+    // criterion.IsUniform(rect, color) 判斷節點是否不需分裂並給出顏色 (ColorChangeTable 或 ColorStatsTable)
+    template <typename Criterion>
+    static void SplitNode(const Criterion& criterion, uint64_t code, int level, const Rect& rect, int maxLevel, vector<Leaf>& leaves) {
+        // 超過最大上限的節點不分裂，維持預設顏色
+        if (level > maxLevel) {
+            leaves.push_back({ code, (uchar)level, DefaultColor() });
+            return;
+        }
+        Vec3b color;
+        if (criterion.IsUniform(rect, color)) {
+            leaves.push_back({ code, (uchar)level, color });
+            return;
+        }
+
+        CV_Assert(level + 1 < MAX_LEVEL);
+        Rect childrens[4];
+        ChildRects(rect, childrens);
+        for (int i = 0; i < 4; i++)
+            SplitNode(criterion, code | ((uint64_t)i << ShiftOf(level)), level + 1, childrens[i], maxLevel, leaves);
+    }
+
+    // 依深度優先順序展開節點，直到面積不大於 grain 或不需分裂
+    template <typename Criterion>
+    void CollectSplitTasks(const Criterion& criterion, uint64_t code, int level, const Rect& rect, int maxLevel, vector<SplitTask>& tasks) const {
+        Vec3b color;
+        if (rect.area() <= _parallelGrain || level > maxLevel || criterion.IsUniform(rect, color)) {
+            tasks.push_back({ code, level, rect });
+            return;
+        }
+        CV_Assert(level + 1 < MAX_LEVEL);
+        Rect childrens[4];
+        ChildRects(rect, childrens);
+        for (int i = 0; i < 4; i++)
+            CollectSplitTasks(criterion, code | ((uint64_t)i << ShiftOf(level)), level + 1, childrens[i], maxLevel, tasks);
+    }
+
+    // 由根節點分裂，平行時各子樹工作分別建立葉節點後依序串接
+    template <typename Criterion>
+    bool SplitRoot(const Criterion& criterion, int maxLevel) {
+        _leaves.clear();
+        if (_parallelGrain <= 0) {
+            SplitNode(criterion, 0, 0, _rect, maxLevel, _leaves);
+            return _leaves.size() > 1;
+        }
+
+        vector<SplitTask> tasks;
+        CollectSplitTasks(criterion, 0, 0, _rect, maxLevel, tasks);
+        image_kernel::ParallelFor(0, (int)tasks.size(), 1, [&](int begin, int end) {
+            for (int t = begin; t < end; t++)
+                SplitNode(criterion, tasks[t].code, tasks[t].level, tasks[t].rect, maxLevel, tasks[t].leaves);
+        });
+
+        // 依工作順序串接，即為深度優先順序
+        size_t leafNum = 0;
+        for (const SplitTask& task : tasks)
+            leafNum += task.leaves.size();
+        _leaves.reserve(leafNum);
+        for (const SplitTask& task : tasks)
+            _leaves.insert(_leaves.end(), task.leaves.begin(), task.leaves.end());
+        return _leaves.size() > 1;
+    }
+
+    // 兩個路徑碼相同的層數 (a != b)
+    static int SharedLevels(uint64_t a, uint64_t b) {
+        uint64_t diff = a ^ b;
+        int highestBit = 0;
+#ifdef _MSC_VER
+        unsigned long index;
+        if (_BitScanReverse(&index, (unsigned long)(diff >> 32)))
+            highestBit = (int)index + 32;
+        else if (_BitScanReverse(&index, (unsigned long)diff))
+            highestBit = (int)index;
+#else
+        highestBit = 63 - __builtin_clzll(diff);
+#endif
+        return MAX_LEVEL - 1 - highestBit / 2;
+    }
+
+    // 第 index 個葉節點在此層數以上 (且小於自身層數) 為該層祖先下的第一個葉節點
+    // 與前一個葉節點共同祖先以下的層、或前一個葉節點已結束的層
+    int FirstUnderLevel(int index) const {
+        if (index == 0)
+            return 0;
+        const Leaf& previous = _leaves[index - 1];
+        return std::min(SharedLevels(previous.code, _leaves[index].code) + 1, (int)previous.level);
+    }
+
+    static void FillRect(Mat& image, const Rect& rect, const Vec3b& color) {
+        for (int i = rect.x; i < rect.x + rect.width; i++) {
+            Vec3b* row = image.ptr<Vec3b>(i);
+            for (int j = rect.y; j < rect.y + rect.height; j++)
+                row[j] = color;
+        }
+    }
+
+    // 像素顏色，CV_8UC1 時三個通道相同
+    static Vec3b PixelColor(uchar value) {
+        return Vec3b(value, value, value);
+    }
+
+    static Vec3b PixelColor(const Vec3b& value) {
+        return value;
+    }
+
+    // image (CV_8UC1 或 CV_8UC3) 第 row 列、第 col 行的顏色
+    static Vec3b ColorAt(const Mat& image, int row, int col) {
+        return image.channels() == 1 ? PixelColor(image.at<uchar>(row, col)) : image.at<Vec3b>(row, col);
+    }
+
+    // 以 Pixel (uchar 或 Vec3b) 讀取像素的 IsUniformIn
+    template <typename Pixel>
+    static bool IsUniformIn(const Mat& image, const Rect& rect, bool& hasColor, Vec3b& color) {
+        for (int i = rect.x; i < rect.x + rect.width; i++) {
+            const Pixel* row = image.ptr<Pixel>(i);
+            for (int j = rect.y; j < rect.y + rect.height; j++) {
+                if (!hasColor) {
+                    color = PixelColor(row[j]);
+                    hasColor = true;
+                }
+                else if (PixelColor(row[j]) != color)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // rect 內的像素是否皆與 color 相同，hasColor 為 false 時以第一個像素為 color
+    static bool IsUniformIn(const Mat& image, const Rect& rect, bool& hasColor, Vec3b& color) {
+        if (image.channels() == 1)
+            return IsUniformIn<uchar>(image, rect, hasColor, color);
+        return IsUniformIn<Vec3b>(image, rect, hasColor, color);
+    }
+
+    static bool IntersectsAny(const Rect& rect, const vector<Rect>& regions) {
+        for (const Rect& region : regions)
+            if ((region & rect).area() > 0)
+                return true;
+        return false;
+    }
+
+    // 將節點的葉節點範圍 [begin, end) 依路徑碼切成四個子節點的範圍，第 i 個子節點為 bounds[i] ~ bounds[i + 1]
+    static void ChildRanges(const vector<Leaf>& leaves, uint64_t code, int level, int begin, int end, int* bounds) {
+        bounds[0] = begin;
+        bounds[4] = end;
+        for (int i = 1; i < 4; i++) {
+            const uint64_t childCode = code | ((uint64_t)i << ShiftOf(level));
+            bounds[i] = (int)(std::lower_bound(leaves.begin() + bounds[i - 1], leaves.begin() + end, childCode,
+                [](const Leaf& leaf, uint64_t value) { return leaf.code < value; }) - leaves.begin());
+        }
+    }
+
+    // 依新影像重建節點，oldLeaves [begin, end) 為舊樹中此節點的葉節點 (或涵蓋此節點的祖先葉節點)
+    // dirtyRects[level] 為與此節點相交的改變區塊，沒有相交時直接沿用舊的子樹
+    // 由下而上: 四個子節點皆為同色葉節點，且不屬於子節點的部分 (奇數邊長的剩餘部分) 也同色時合併，結果與重新分裂相同
+    void UpdateNode(const Mat& image, const vector<Leaf>& oldLeaves, int begin, int end, uint64_t code, int level, const Rect& rect,
+        int maxLevel, vector<vector<Rect>>& dirtyRects, vector<Leaf>& leaves, vector<Rect>* redrawRects) const {
+        if (level > maxLevel) {
+            leaves.push_back({ code, (uchar)level, DefaultColor() });
+            return;
+        }
+        if (rect.area() <= 1) {
+            leaves.push_back({ code, (uchar)level, ColorAt(image, rect.x, rect.y) });
+            return;
+        }
+
+        const bool isOldLeaf = end - begin == 1 && oldLeaves[begin].level <= level;
+        if (dirtyRects[level].empty()) {
+            if (isOldLeaf)
+                leaves.push_back({ code, (uchar)level, oldLeaves[begin].color });
+            else
+                leaves.insert(leaves.end(), oldLeaves.begin() + begin, oldLeaves.begin() + end);
+            return;
+        }
+
+        Vec3b color;
+        bool hasColor = false;
+        // 子節點超過最大上限，無法由子節點判斷，直接檢查整個節點
+        // 分裂與否改變時未改變的像素也會改畫成預設顏色或節點顏色，整個節點需要重畫
+        if (level == maxLevel) {
+            if (redrawRects != nullptr)
+                redrawRects->push_back(rect);
+            if (IsUniformIn(image, rect, hasColor, color)) {
+                leaves.push_back({ code, (uchar)level, color });
+                return;
+            }
+            for (int i = 0; i < 4; i++)
+                leaves.push_back({ code | ((uint64_t)i << ShiftOf(level)), (uchar)(level + 1), DefaultColor() });
+            return;
+        }
+
+        CV_Assert(level + 1 < MAX_LEVEL);
+        int bounds[5];
+        if (!isOldLeaf)
+            ChildRanges(oldLeaves, code, level, begin, end, bounds);
+        Rect childrens[4];
+        ChildRects(rect, childrens);
+        const size_t first = leaves.size();
+        for (int i = 0; i < 4; i++) {
+            vector<Rect>& childDirtyRects = dirtyRects[level + 1];
+            childDirtyRects.clear();
+            for (const Rect& dirty : dirtyRects[level])
+                if ((dirty & childrens[i]).area() > 0)
+                    childDirtyRects.push_back(dirty);
+            UpdateNode(image, oldLeaves, isOldLeaf ? begin : bounds[i], isOldLeaf ? end : bounds[i + 1],
+                code | ((uint64_t)i << ShiftOf(level)), level + 1, childrens[i], maxLevel, dirtyRects, leaves, redrawRects);
+        }
+
+        // 任一子節點分裂時至少有 7 個葉節點
+        if (leaves.size() - first != 4)
+            return;
+        for (int i = 0; i < 4; i++) {
+            if (childrens[i].area() == 0)
+                continue;
+            if (hasColor && leaves[first + i].color != color)
+                return;
+            color = leaves[first + i].color;
+            hasColor = true;
+        }
+        const int coveredWidth = rect.width / 2 * 2;
+        const int coveredHeight = rect.height / 2 * 2;
+        if (!IsUniformIn(image, Rect(rect.x + coveredWidth, rect.y, rect.width - coveredWidth, rect.height), hasColor, color)
+            || !IsUniformIn(image, Rect(rect.x, rect.y + coveredHeight, coveredWidth, rect.height - coveredHeight), hasColor, color))
+            return;
+        leaves.resize(first);
+        leaves.push_back({ code, (uchar)level, color });
+    }
+
+    // 重畫與 regions 相交的葉節點 (或 maxLevel 層的非葉節點)，[begin, end) 為此節點的葉節點
+    void DrawRegions(Mat& image, const vector<Rect>& regions, int begin, int end, uint64_t code, int level, const Rect& rect, int maxLevel) const {
+        if (!IntersectsAny(rect, regions))
+            return;
+        if (end - begin == 1) {
+            FillRect(image, rect, _leaves[begin].color);
+            return;
+        }
+        if (level >= maxLevel) {
+            FillRect(image, rect, DefaultColor());
+            return;
+        }
+        int bounds[5];
+        ChildRanges(_leaves, code, level, begin, end, bounds);
+        Rect childrens[4];
+        ChildRects(rect, childrens);
+        for (int i = 0; i < 4; i++)
+            DrawRegions(image, regions, bounds[i], bounds[i + 1], code | ((uint64_t)i << ShiftOf(level)), level + 1, childrens[i], maxLevel);
+    }
+
+public:
+    // 子節點範圍，依序為左上、x 方向後半、y 方向後半、兩者皆後半
+    static void ChildRects(const Rect& rect, Rect* childrens) {
+        int halfWidth = rect.width / 2;
+        int halfHeight = rect.height / 2;
+        childrens[0] = Rect(rect.x, rect.y, halfWidth, halfHeight);
+        childrens[1] = Rect(rect.x + halfWidth, rect.y, halfWidth, halfHeight);
+        childrens[2] = Rect(rect.x, rect.y + halfHeight, halfWidth, halfHeight);
+        childrens[3] = Rect(rect.x + halfWidth, rect.y + halfHeight, halfWidth, halfHeight);
+    }
+
+    LinearQuadtree(Rect rect) {
+        this->_rect = rect;
+        this->_leaves.push_back({ 0, 0, DefaultColor() });
+    }
+
+    const vector<Leaf>& Leaves() const {
+        return _leaves;
+    }
+
+    // 平行分裂與繪製，grain: 子樹工作的最大面積 (像素數)，0 為單執行緒
+    void SetParallelGrain(int grain) {
+        _parallelGrain = grain;
+    }
+
+    // 由路徑碼推算節點範圍
+    Rect RectOf(uint64_t code, int level) const {
+        int x = _rect.x, y = _rect.y, width = _rect.width, height = _rect.height;
+        for (int d = 0; d < level; d++) {
+            int quadrant = (int)(code >> ShiftOf(d)) & 3;
+            width /= 2;
+            height /= 2;
+            if (quadrant & 1)
+                x += width;
+            if (quadrant & 2)
+                y += height;
+        }
+        return Rect(x, y, width, height);
+    }
+
+    // 分裂根節點，結果與 QuadtreeNode::SplitNode 相同，image: CV_8UC1 或 CV_8UC3
+    bool SplitNode(const Mat& image, int maxLevel = INT_MAX) {
+        // 已分裂或達到最大上限不分裂
+        if (maxLevel < 0 || _leaves.size() > 1)
+            return false;
+
+        ColorChangeTable colorChange(image, _parallelGrain > 0);
+        return SplitRoot(colorChange, maxLevel);
+    }
+
+    // 以容許值分裂根節點，各通道標準差不大於 tolerance 的節點不再分裂，顏色為平均顏色
+    // image: CV_8UC1 或 CV_8UC3，tolerance = 0 時與 SplitNode 相同
+    bool SplitNodeByVariance(const Mat& image, double tolerance, int maxLevel = INT_MAX) {
+        if (maxLevel < 0 || _leaves.size() > 1)
+            return false;
+
+        ColorStatsTable colorStats(image, tolerance, _parallelGrain > 0);
+        return SplitRoot(colorStats, maxLevel);
+    }
+
+    // 合併相鄰且合併後各通道標準差仍不大於 tolerance 的葉節點 (union-find，依掃描順序檢查相鄰葉節點)
+    // 葉節點顏色改為所屬區域的平均顏色，leafRegions: 各葉節點的區域編號 (0 起)，回傳區域數
+    int MergeLeaves(const Mat& image, double tolerance, vector<int>* leafRegions = nullptr) {
+        ColorStatsTable colorStats(image, tolerance, _parallelGrain > 0);
+        const int leafNum = (int)_leaves.size();
+
+        // 各葉節點的統計量與葉節點編號圖，根節點保存整個區域的統計量
+        vector<RegionStats> regions(leafNum);
+        vector<int> parent(leafNum);
+        Mat leafIds(image.size(), CV_32S, Scalar(-1));
+        for (int i = 0; i < leafNum; i++) {
+            const Rect rect = RectOf(_leaves[i].code, _leaves[i].level);
+            regions[i] = colorStats.StatsOf(rect);
+            parent[i] = i;
+            for (int row = rect.x; row < rect.x + rect.width; row++) {
+                int* ids = leafIds.ptr<int>(row);
+                for (int col = rect.y; col < rect.y + rect.height; col++)
+                    ids[col] = i;
+            }
+        }
+
+        auto find = [&parent](int x) {
+            while (parent[x] != x) {
+                parent[x] = parent[parent[x]];
+                x = parent[x];
+            }
+            return x;
+        };
+        auto tryMerge = [&](int a, int b) {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+                return;
+            RegionStats merged = regions[a];
+            merged.Merge(regions[b]);
+            if (!merged.WithinTolerance(tolerance))
+                return;
+            if (b < a)
+                std::swap(a, b);
+            parent[b] = a;
+            regions[a] = merged;
+        };
+
+        // 相鄰的葉節點只在邊界上出現，同一對連續出現時只檢查一次
+        for (int row = 0; row < leafIds.rows; row++) {
+            const int* ids = leafIds.ptr<int>(row);
+            const int* upIds = row > 0 ? leafIds.ptr<int>(row - 1) : nullptr;
+            int lastId = -1, lastUpId = -1;
+            for (int col = 0; col < leafIds.cols; col++) {
+                const int id = ids[col];
+                if (id < 0)
+                    continue;
+                if (col > 0 && ids[col - 1] >= 0 && ids[col - 1] != id)
+                    tryMerge(ids[col - 1], id);
+                if (upIds && upIds[col] >= 0 && upIds[col] != id && (upIds[col] != lastUpId || id != lastId))
+                    tryMerge(upIds[col], id);
+                lastId = id;
+                lastUpId = upIds ? upIds[col] : -1;
+            }
+        }
+
+        // 區域依第一個葉節點編號，葉節點改為區域平均顏色
+        vector<int> regionIds(leafNum, -1);
+        int regionNum = 0;
+        if (leafRegions != nullptr)
+            leafRegions->resize(leafNum);
+        for (int i = 0; i < leafNum; i++) {
+            const int root = find(i);
+            if (regionIds[root] < 0)
+                regionIds[root] = regionNum++;
+            if (regions[root].count > 0)
+                _leaves[i].color = regions[root].Mean();
+            if (leafRegions != nullptr)
+                (*leafRegions)[i] = regionIds[root];
+        }
+        return regionNum;
+    }
+
+    // 影像只在 dirtyRects 內改變時更新已分裂的樹，結果與以新影像重新 SplitNode 相同 (maxLevel 須與分裂時相同)
+    // 只有與 dirtyRects 相交的節點重新判斷 (分裂或合併)，其餘子樹直接沿用，像素的處理量與改變的面積成正比
+    // image: CV_8UC1 或 CV_8UC3 (與分裂時相同)，dirtyRects 與 QuadtreeNode 相同: x、width 為列方向
+    // redrawRects: 繪製結果可能改變的區塊 (dirtyRects 與 maxLevel 層重新判斷的節點)
+    void UpdateNode(const Mat& image, const vector<Rect>& dirtyRects, int maxLevel = INT_MAX, vector<Rect>* redrawRects = nullptr) {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        vector<vector<Rect>> dirtyByLevel(MAX_LEVEL + 1);
+        for (const Rect& dirty : dirtyRects)
+            if ((dirty & _rect).area() > 0)
+                dirtyByLevel[0].push_back(dirty & _rect);
+        if (redrawRects != nullptr)
+            *redrawRects = dirtyByLevel[0];
+        if (dirtyByLevel[0].empty())
+            return;
+
+        vector<Leaf> leaves;
+        leaves.reserve(_leaves.size());
+        UpdateNode(image, _leaves, 0, (int)_leaves.size(), 0, 0, _rect, maxLevel, dirtyByLevel, leaves, redrawRects);
+        _leaves.swap(leaves);
+    }
+
+    // 比較前後兩張影像，回傳有差異的區塊 (tileSize x tileSize，同一列相鄰的區塊合併)，座標與 QuadtreeNode 相同
+    vector<Rect> DiffRects(const Mat& previousImage, const Mat& image, int tileSize = 32) const {
+        CV_Assert(previousImage.size() == image.size() && previousImage.type() == image.type());
+        const int tileRows = (image.rows + tileSize - 1) / tileSize;
+        const int tileCols = (image.cols + tileSize - 1) / tileSize;
+        const size_t pixelSize = image.elemSize();
+        vector<vector<Rect>> rowRects(tileRows);
+        image_kernel::ParallelFor(0, tileRows, _parallelGrain > 0 ? 1 : tileRows, [&](int begin, int end) {
+            vector<char> changed(tileCols);
+            for (int t = begin; t < end; t++) {
+                const int row0 = t * tileSize, row1 = std::min(row0 + tileSize, image.rows);
+                std::fill(changed.begin(), changed.end(), 0);
+                for (int row = row0; row < row1; row++) {
+                    const uchar* previousRow = previousImage.ptr<uchar>(row);
+                    const uchar* currentRow = image.ptr<uchar>(row);
+                    for (int k = 0; k < tileCols; k++) {
+                        const int col0 = k * tileSize, col1 = std::min(col0 + tileSize, image.cols);
+                        if (!changed[k])
+                            changed[k] = memcmp(previousRow + col0 * pixelSize, currentRow + col0 * pixelSize, (col1 - col0) * pixelSize) != 0;
+                    }
+                }
+                for (int k = 0; k < tileCols; k++) {
+                    if (!changed[k])
+                        continue;
+                    int last = k;
+                    while (last + 1 < tileCols && changed[last + 1])
+                        last++;
+                    const int col0 = k * tileSize, col1 = std::min((last + 1) * tileSize, image.cols);
+                    rowRects[t].push_back(Rect(row0, col0, row1 - row0, col1 - col0));
+                    k = last;
+                }
+            }
+        });
+
+        vector<Rect> rects;
+        for (const vector<Rect>& row : rowRects)
+            rects.insert(rects.end(), row.begin(), row.end());
+        return rects;
+    }
+
+    // 只重畫 regions 內可能改變的部分: 與 regions 相交的葉節點 (或 maxLevel 層的非葉節點) 整個重畫
+    // 以 UpdateNode 的 redrawRects 作為 regions 時，更新前的繪製結果重畫後與重新 DrawNode 相同 (不屬於任何葉節點的像素維持原值)
+    void DrawRegions(Mat& image, const vector<Rect>& regions, int maxLevel = INT_MAX) const {
+        if (maxLevel < 0 || regions.empty())
+            return;
+        DrawRegions(image, regions, 0, (int)_leaves.size(), 0, 0, _rect, maxLevel);
+    }
+
+    // 序列化: 檔頭、層序的分裂位元 (1 為內部節點)、每 64 bit 之前的 1 個數、依層序排列的葉節點顏色
+    // 第 i 個內部節點的子節點位於 1 + 4i ~ 4 + 4i，葉節點顏色位置為之前的葉節點數，查詢時不需重建樹
+    vector<uchar> Serialize() const;
+
+    bool SaveToFile(const string& path) const {
+        vector<uchar> data = Serialize();
+        std::ofstream file(path, std::ios::binary);
+        file.write((const char*)data.data(), data.size());
+        return file.good();
+    }
+
+    // 將樹繪製到 image，結果與 QuadtreeNode::DrawNode 相同
+    // 超過 maxLevel 的葉節點由 maxLevel 層的祖先以預設顏色繪製，同一祖先的葉節點相鄰，只由第一個葉節點繪製
+    // 各葉節點繪製的範圍互不重疊，平行時直接切分葉節點陣列
+    void DrawNode(Mat& image, int maxLevel = INT_MAX) const {
+        const int leafNum = (int)_leaves.size();
+        const int grain = _parallelGrain > 0 ? DRAW_GRAIN : leafNum;
+        image_kernel::ParallelFor(0, leafNum, grain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Leaf& leaf = _leaves[i];
+                if (leaf.level <= maxLevel) {
+                    FillRect(image, RectOf(leaf.code, leaf.level), leaf.color);
+                    continue;
+                }
+                if (maxLevel >= FirstUnderLevel(i))
+                    FillRect(image, RectOf(leaf.code & AncestorMask(maxLevel), maxLevel), DefaultColor());
+            }
+        });
+    }
+
+    // 依序產生 firstLayer ~ lastLayer 各層圖片，每層完成時呼叫 onLayer，各層結果與 DrawNode 相同
+    // 只走訪一次: 繪製 firstLayer，並記錄之後每一層與上一層不同的區塊
+    // 上一層的非葉節點整塊為預設顏色，其下的非葉節點不需重畫，每一層只需補畫該層的葉節點，各層合計約為繪製整張圖一次
+    void DrawLayers(Mat& image, int firstLayer, int lastLayer, const std::function<void(int layer, const Mat& image)>& onLayer) const {
+        const int layerNum = lastLayer - firstLayer + 1;
+        vector<vector<LayerPatch>> patches(layerNum);
+
+        std::mutex patchMutex;
+        const int leafNum = (int)_leaves.size();
+        const int grain = _parallelGrain > 0 ? DRAW_GRAIN : leafNum;
+        image_kernel::ParallelFor(0, leafNum, grain, [&](int begin, int end) {
+            vector<vector<LayerPatch>> localPatches(layerNum);
+            for (int i = begin; i < end; i++) {
+                const Leaf& leaf = _leaves[i];
+                if (leaf.level <= firstLayer) {
+                    FillRect(image, RectOf(leaf.code, leaf.level), leaf.color);
+                    continue;
+                }
+                if (firstLayer >= FirstUnderLevel(i))
+                    FillRect(image, RectOf(leaf.code & AncestorMask(firstLayer), firstLayer), DefaultColor());
+                // 之後各層: 只在葉節點所在的層畫葉節點
+                if (leaf.level <= lastLayer)
+                    localPatches[leaf.level - firstLayer].push_back({ RectOf(leaf.code, leaf.level), leaf.color });
+            }
+            std::lock_guard<std::mutex> lock(patchMutex);
+            for (int k = 0; k < layerNum; k++)
+                patches[k].insert(patches[k].end(), localPatches[k].begin(), localPatches[k].end());
+        });
+
+        onLayer(firstLayer, image);
+        for (int layer = firstLayer + 1; layer <= lastLayer; layer++) {
+            const vector<LayerPatch>& layerPatches = patches[layer - firstLayer];
+            image_kernel::ParallelFor(0, (int)layerPatches.size(), _parallelGrain > 0 ? DRAW_GRAIN : (int)layerPatches.size(), [&](int begin, int end) {
+                for (int k = begin; k < end; k++)
+                    FillRect(image, layerPatches[k].rect, layerPatches[k].color);
+            });
+            onLayer(layer, image);
+        }
+    }
+};
+
+// 序列化 quadtree 的檔頭 (little endian)
+struct QuadtreeFileHeader
+{
+    char magic[4];          // "QTR1"
+    int32_t x, y, width, height;
+    uint32_t nodeCount;
+    uint32_t leafCount;
+    uint32_t reserved;
+};
+
+namespace quadtree_file {
+    const char MAGIC[4] = { 'Q', 'T', 'R', '1' };
+
+    inline int PopCount(uint64_t x) {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((x * 0x0101010101010101ULL) >> 56);
+    }
+
+    inline size_t WordCountOf(uint32_t nodeCount) {
+        return (nodeCount + 63) / 64;
+    }
+
+    // 各區段的位移，皆對齊 8 byte
+    inline size_t BitsOffset() {
+        return sizeof(QuadtreeFileHeader);
+    }
+
+    inline size_t RankOffset(uint32_t nodeCount) {
+        return BitsOffset() + WordCountOf(nodeCount) * sizeof(uint64_t);
+    }
+
+    inline size_t ColorsOffset(uint32_t nodeCount) {
+        return RankOffset(nodeCount) + ((WordCountOf(nodeCount) + 2) / 2) * 2 * sizeof(uint32_t);
+    }
+}
+
+vector<uchar> LinearQuadtree::Serialize() const {
+    // 依層產生節點，每個節點為葉節點陣列中共同前綴的一段
+    struct Range
+    {
+        int begin;
+        int end;
+    };
+    vector<uint64_t> bits;
+    vector<uchar> colors;
+    uint32_t nodeCount = 0;
+    vector<Range> current(1, { 0, (int)_leaves.size() }), next;
+    for (int level = 0; !current.empty(); level++) {
+        next.clear();
+        for (const Range& range : current) {
+            const bool isInternal = !(range.end - range.begin == 1 && _leaves[range.begin].level == level);
+            if (nodeCount % 64 == 0)
+                bits.push_back(0);
+            if (isInternal)
+                bits.back() |= 1ULL << (nodeCount % 64);
+            nodeCount++;
+
+            if (!isInternal) {
+                const Vec3b& color = _leaves[range.begin].color;
+                colors.insert(colors.end(), { color[0], color[1], color[2] });
+                continue;
+            }
+            // 子節點依路徑碼切分
+            int begin = range.begin;
+            for (int i = 0; i < 4; i++) {
+                int end = begin;
+                while (end < range.end && (int)((_leaves[end].code >> ShiftOf(level)) & 3) == i)
+                    end++;
+                next.push_back({ begin, end });
+                begin = end;
+            }
+        }
+        std::swap(current, next);
+    }
+
+    QuadtreeFileHeader header;
+    memcpy(header.magic, quadtree_file::MAGIC, sizeof(header.magic));
+    header.x = _rect.x;
+    header.y = _rect.y;
+    header.width = _rect.width;
+    header.height = _rect.height;
+    header.nodeCount = nodeCount;
+    header.leafCount = (uint32_t)_leaves.size();
+    header.reserved = 0;
+
+    vector<uchar> data(quadtree_file::ColorsOffset(nodeCount) + colors.size(), 0);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + quadtree_file::BitsOffset(), bits.data(), bits.size() * sizeof(uint64_t));
+    uint32_t* rank = (uint32_t*)(data.data() + quadtree_file::RankOffset(nodeCount));
+    rank[0] = 0;
+    for (size_t w = 0; w < bits.size(); w++)
+        rank[w + 1] = rank[w] + quadtree_file::PopCount(bits[w]);
+    memcpy(data.data() + quadtree_file::ColorsOffset(nodeCount), colors.data(), colors.size());
+    return data;
+}
+
+// 唯讀的記憶體映射檔案
+class MappedFile
+{
+private:
+    const uchar* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+#else
+    int _file = -1;
+#endif
+
+public:
+    MappedFile(const string& path) {
+#ifdef _WIN32
+        _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+            return;
+        _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_mapping)
+            return;
+        _data = (const uchar*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+        _size = _data ? (size_t)size.QuadPart : 0;
+#else
+        _file = open(path.c_str(), O_RDONLY);
+        if (_file < 0)
+            return;
+        struct stat info;
+        if (fstat(_file, &info) != 0 || info.st_size == 0)
+            return;
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, _file, 0);
+        if (data == MAP_FAILED)
+            return;
+        _data = (const uchar*)data;
+        _size = (size_t)info.st_size;
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (_data)
+            UnmapViewOfFile(_data);
+        if (_mapping)
+            CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+#else
+        if (_data)
+            munmap((void*)_data, _size);
+        if (_file >= 0)
+            close(_file);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return _data != nullptr; }
+    const uchar* Data() const { return _data; }
+    size_t Size() const { return _size; }
+};
+
+// 直接在序列化資料 (例如 MappedFile) 上查詢 quadtree，不需反序列化
+// 範圍與座標與 QuadtreeNode 相同: x、row 為列方向，y、col 為行方向
+class QuadtreeView
+{
+public:
+    struct LeafInfo
+    {
+        Rect rect;
+        int level;
+        Vec3b color;
+    };
+
+private:
+    QuadtreeFileHeader _header;
+    const uint64_t* _bits;
+    const uint32_t* _rank;
+    const uchar* _colors;
+
+    bool IsInternal(uint32_t node) const {
+        return (_bits[node / 64] >> (node % 64)) & 1;
+    }
+
+    // node 之前的內部節點數
+    uint32_t InternalBefore(uint32_t node) const {
+        const uint64_t lowBits = node % 64 ? _bits[node / 64] & (~0ULL >> (64 - node % 64)) : 0;
+        return _rank[node / 64] + quadtree_file::PopCount(lowBits);
+    }
+
+    uint32_t ChildOf(uint32_t node, int i) const {
+        return 1 + 4 * InternalBefore(node) + i;
+    }
+
+    Vec3b ColorOf(uint32_t node) const {
+        const uchar* color = _colors + (size_t)(node - InternalBefore(node)) * 3;
+        return Vec3b(color[0], color[1], color[2]);
+    }
+
+    void CollectLeaves(uint32_t node, const Rect& nodeRect, int level, const Rect& rect, vector<LeafInfo>& leaves) const {
+        if ((nodeRect & rect).area() == 0)
+            return;
+        if (!IsInternal(node)) {
+            leaves.push_back({ nodeRect, level, ColorOf(node) });
+            return;
+        }
+        Rect childrens[4];
+        LinearQuadtree::ChildRects(nodeRect, childrens);
+        for (int i = 0; i < 4; i++)
+            CollectLeaves(ChildOf(node, i), childrens[i], level + 1, rect, leaves);
+    }
+
+public:
+    QuadtreeView(const uchar* data, size_t size) {
+        CV_Assert(data != nullptr && size >= sizeof(QuadtreeFileHeader));
+        memcpy(&_header, data, sizeof(_header));
+        CV_Assert(memcmp(_header.magic, quadtree_file::MAGIC, sizeof(_header.magic)) == 0);
+        CV_Assert(size >= quadtree_file::ColorsOffset(_header.nodeCount) + (size_t)_header.leafCount * 3);
+        _bits = (const uint64_t*)(data + quadtree_file::BitsOffset());
+        _rank = (const uint32_t*)(data + quadtree_file::RankOffset(_header.nodeCount));
+        _colors = data + quadtree_file::ColorsOffset(_header.nodeCount);
+    }
+
+    Rect RootRect() const {
+        return Rect(_header.x, _header.y, _header.width, _header.height);
+    }
+
+    int NodeCount() const { return (int)_header.nodeCount; }
+    int LeafCount() const { return (int)_header.leafCount; }
+
+    // (row, col) 所在葉節點的顏色，不在任何葉節點內 (超出範圍或奇數邊長的剩餘部分) 時回傳 false
+    bool ColorAt(int row, int col, Vec3b& color) const {
+        Rect nodeRect = RootRect();
+        uint32_t node = 0;
+        while (true) {
+            if (row < nodeRect.x || row >= nodeRect.x + nodeRect.width || col < nodeRect.y || col >= nodeRect.y + nodeRect.height)
+                return false;
+            if (!IsInternal(node)) {
+                color = ColorOf(node);
+                return true;
+            }
+            Rect childrens[4];
+            LinearQuadtree::ChildRects(nodeRect, childrens);
+            int i = (row >= childrens[1].x ? 1 : 0) | (col >= childrens[2].y ? 2 : 0);
+            node = ChildOf(node, i);
+            nodeRect = childrens[i];
+        }
+    }
+
+    // 與 rect 相交的葉節點
+    vector<LeafInfo> LeavesIn(const Rect& rect) const {
+        vector<LeafInfo> leaves;
+        CollectLeaves(0, RootRect(), 0, rect, leaves);
+        return leaves;
+    }
+
+    // 各顏色的面積 (像素數)，key 為 B | G << 8 | R << 16
+    // 同一層的節點大小相同，依層序掃描即可，不需走訪樹
+    map<uint32_t, long long> AreaPerColor() const {
+        map<uint32_t, long long> areas;
+        int width = _header.width, height = _header.height;
+        uint32_t levelBegin = 0, levelEnd = 1;
+        while (levelBegin < _header.nodeCount) {
+            const uint32_t internalNum = InternalBefore(levelEnd) - InternalBefore(levelBegin);
+            for (uint32_t node = levelBegin; node < levelEnd; node++) {
+                if (IsInternal(node))
+                    continue;
+                Vec3b color = ColorOf(node);
+                areas[color[0] | (color[1] << 8) | (color[2] << 16)] += (long long)width * height;
+            }
+            levelBegin = levelEnd;
+            levelEnd += 4 * internalNum;
+            width /= 2;
+            height /= 2;
+        }
+        return areas;
+    }
+};
+
 class ImageLibrary
 {
 public:
@@ -93,48 +1177,53 @@ public:
         
     }
 
-    // Ƕ
+    // 轉灰階
     Mat ConvertToGray(const Mat& colorImage) {
-        Mat grayImage(colorImage.size(), CV_8UC3);
-
-        for (int i = 0; i < colorImage.rows; i++) {
-            for (int j = 0; j < colorImage.cols; j++) {
-                Vec3b pixel = colorImage.at<Vec3b>(i, j);
-                int grayValue = 0.3 * pixel[2] + 0.59 * pixel[1] + 0.11 * pixel[0];
-                grayImage.at<uchar>(i, j) = grayValue;
-            }
-        }
-        return grayImage;
+        // 0.3 R + 0.59 G + 0.11 B
+        return image_kernel::ConvertBgrToGray(colorImage, image_kernel::GrayWeights::Luma);
     }
 
-    // ǶGȤ
+    // 灰階二值化
     Mat ConvertToBinary(const Mat& colorImage, uchar threshold = 128) {
-        Mat grayImage = this->ConvertToGray(colorImage);
-        Mat binaryImage(grayImage.size(), CV_8UC1);
-
-        for (int i = 0; i < grayImage.rows; i++)
-            for (int j = 0; j < grayImage.cols; j++)
-                binaryImage.at<uchar>(i, j) = grayImage.at<uchar>(i, j) > threshold ? 255 : 0;
-        return binaryImage;
+        // 灰階與二值化一次完成，不產生灰階圖
+        return image_kernel::ConvertBgrToBinary(colorImage, threshold, image_kernel::GrayWeights::Luma);
     }
 
     // Quadtree
     Mat SplitImageByQuadtree(const Mat& srcImage, int layer = INT_MAX) {
-        Mat splitImage = srcImage;
         Mat resultImage(srcImage.size(), CV_8UC3);
 
-        // N binaryImage ର 3 qD
-        if (srcImage.type() != CV_8UC3)
-        {
-            splitImage = Mat(srcImage.size(), CV_8UC3);
-            for (int i = 0; i < srcImage.rows; i++)
-                for (int j = 0; j < srcImage.cols; j++)
-                    splitImage.at<Vec3b>(i, j) = Vec3b(srcImage.at<uchar>(i, j), srcImage.at<uchar>(i, j), srcImage.at<uchar>(i, j));
-        }
+        // 切分並繪製 Quadtree 圖片 (二值圖直接以單通道分裂)
+        LinearQuadtree root = LinearQuadtree(Rect(0, 0, srcImage.cols, srcImage.rows));
+        root.SetParallelGrain(64 * 64); // 64 x 64 以下的子樹不再切分工作
+        root.SplitNode(srcImage, layer);
+        root.DrawNode(resultImage);
+        return resultImage;
+    }
 
-        // øs Quadtree Ϥ
-        QuadtreeNode root = QuadtreeNode(Rect(0, 0, srcImage.cols, srcImage.rows), 0);
-        root.SplitNode(splitImage, layer);
+    // 連續影格: root、resultImage 為上一張影格 previousImage 分裂 (maxLevel 為 layer) 與繪製的結果
+    // 只重新分裂、重畫與上一張影格不同的區塊，回傳不同的區塊數，image: CV_8UC1 (如二值圖) 或 CV_8UC3
+    int UpdateSplitImage(LinearQuadtree& root, Mat& resultImage, const Mat& previousImage, const Mat& image, int layer = INT_MAX) {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        vector<Rect> dirtyRects = root.DiffRects(previousImage, image), redrawRects;
+        root.UpdateNode(image, dirtyRects, layer, &redrawRects);
+        root.DrawRegions(resultImage, redrawRects);
+        return (int)dirtyRects.size();
+    }
+
+    // Split and merge 分割，直接處理灰階或彩色圖片
+    // tolerance: 區域內各通道標準差上限，merge: 是否合併相鄰的相近區域，regionNum: 寫入區域數
+    Mat SegmentBySplitAndMerge(const Mat& srcImage, double tolerance, bool merge = true, int* regionNum = nullptr) {
+        LinearQuadtree root = LinearQuadtree(Rect(0, 0, srcImage.cols, srcImage.rows));
+        root.SetParallelGrain(64 * 64);
+        root.SplitNodeByVariance(srcImage, tolerance);
+        int regions = (int)root.Leaves().size();
+        if (merge)
+            regions = root.MergeLeaves(srcImage, tolerance);
+        if (regionNum != nullptr)
+            *regionNum = regions;
+
+        Mat resultImage(srcImage.size(), CV_8UC3);
         root.DrawNode(resultImage);
         return resultImage;
     }
@@ -155,12 +1244,13 @@ public:
 };
 
 int main() {
-    const int IMAGE_NUM = 4; // Ϥ
-    const string IMAGE_FOLDER = "..\\image"; // ϤsƧ
+    const int IMAGE_NUM = 4; // 圖片數
+    const string IMAGE_FOLDER = "..\\image"; // 圖片存放資料夾
     const string IMAGE_PATH_FORMAT = IMAGE_FOLDER + "\\%s.png";
+    const bool SAVE_QUADTREE_FILE = false; // 另外儲存壓縮後的 Quadtree (.qtr) 並輸出各顏色面積，預設只輸出作業要求的圖片
     vector<ImageInfo> images;
 
-    // ϤɦWBthresholdBlayer ]w
+    // 圖片檔名、threshold、layer 設定
     images.push_back(ImageInfo("1", 135, 8));
     images.push_back(ImageInfo("2", 245, 9));
     images.push_back(ImageInfo("3", 155, 8));
@@ -174,34 +1264,38 @@ int main() {
         const string IMAGE_PATH = format(IMAGE_PATH_FORMAT.c_str(), IMAGE_NAME.c_str());
         std::cout << IMAGE_PATH << '\n';
 
-        // ŪϤBGȤ
+        // 讀取圖片、二值化
         Mat colorImage = imread(IMAGE_PATH);
         Mat binaryImage = library.ConvertToBinary(colorImage, image._threshold);
 
         imshow("true-color " + IMAGE_PATH, colorImage);
         imshow("binary " + IMAGE_PATH, binaryImage);
         imwrite(format(IMAGE_PATH_FORMAT.c_str(), (IMAGE_NAME + "_binary").c_str()), binaryImage);
-        
-        // N binaryImage ର 3 qD
-        Mat binaryImageChannel3 = binaryImage;
-        binaryImageChannel3 = Mat(binaryImage.size(), CV_8UC3);
-        for (int i = 0; i < binaryImage.rows; i++)
-            for (int j = 0; j < binaryImage.cols; j++)
-                binaryImageChannel3.at<Vec3b>(i, j) = Vec3b(binaryImage.at<uchar>(i, j), binaryImage.at<uchar>(i, j), binaryImage.at<uchar>(i, j));
-
-        // إ Quadtree öi
-        QuadtreeNode root = QuadtreeNode(Rect(0, 0, binaryImage.cols, binaryImage.rows), 0);
-        root.SplitNode(binaryImageChannel3);
-
-        // ھ layer øs Quadtree Ϥ
-        for (int layer = 1; layer <= image._layer; layer++)
-        {
-            Mat resultImage(binaryImage.size(), CV_8UC3);
-            root.DrawNode(resultImage, layer);
-            imshow("splitted layer" + to_string(layer) + IMAGE_PATH, resultImage);
-            imwrite(format(IMAGE_PATH_FORMAT.c_str(), (IMAGE_NAME + "_splitted layer" + to_string(layer)).c_str()), resultImage);
+
+        // 建立 Quadtree 並直接以單通道的 binaryImage 切分
+        LinearQuadtree root = LinearQuadtree(Rect(0, 0, binaryImage.cols, binaryImage.rows));
+        root.SetParallelGrain(64 * 64); // 64 x 64 以下的子樹不再切分工作
+        root.SplitNode(binaryImage);
+
+        // 儲存壓縮後的 Quadtree，以記憶體映射讀回並查詢各顏色面積 (SAVE_QUADTREE_FILE 開啟時)
+        const string TREE_PATH = IMAGE_FOLDER + "\\" + IMAGE_NAME + ".qtr";
+        if (SAVE_QUADTREE_FILE && root.SaveToFile(TREE_PATH)) {
+            MappedFile treeFile(TREE_PATH);
+            if (treeFile.IsOpen()) {
+                QuadtreeView view(treeFile.Data(), treeFile.Size());
+                std::cout << "quadtree nodes : " << view.NodeCount() << ", file size : " << treeFile.Size() << " bytes\n";
+                for (const auto& area : view.AreaPerColor())
+                    std::cout << "color " << (area.first & 0xFF) << " area : " << area.second << '\n';
+            }
         }
 
+        // 根據 layer 繪製 Quadtree 圖片，所有 layer 一次繪製，每層只補畫與上一層不同的區塊
+        Mat resultImage(binaryImage.size(), CV_8UC3);
+        root.DrawLayers(resultImage, 1, image._layer, [&](int layer, const Mat& layerImage) {
+            imshow("splitted layer" + to_string(layer) + IMAGE_PATH, layerImage);
+            imwrite(format(IMAGE_PATH_FORMAT.c_str(), (IMAGE_NAME + "_splitted layer" + to_string(layer)).c_str()), layerImage);
+        });
+
         cv::waitKey(0);
         cv::destroyAllWindows();
     }
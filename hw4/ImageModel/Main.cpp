@@ -1,6 +1,10 @@
 ﻿#include <iostream>
 #include <filesystem> // ISO C++17 標準 (/std:c++17)
 #include <opencv2/opencv.hpp>
+#include "../../Common/FilterKernel.h"
+#include "../../Common/MedianKernel.h"
+#include "../../Common/GaussianKernel.h"
+#include "../../Common/ThreadPool.h"
 
 using namespace std;
 using namespace cv;
@@ -10,6 +14,7 @@ class Filter
 {
 public:
     Filter() {}
+    virtual ~Filter() {}
 
     // 設定 Mask
     void SetMask(int mask) {
@@ -17,37 +22,71 @@ public:
         this->_mask = (mask < 3) ? 3 : (mask | 1);
     }
 
-    // 各個 Filter 實作 FilterImage 的方法
-    virtual Mat FilterImage(const Mat& sourceImage) = 0;
-
-protected:
-    int _mask = 3;
-
-    // padding 填充圖片
-    virtual Mat PadImage(const Mat& image, int paddingSize)
-    {
-        Mat padded = Mat(image.rows + paddingSize * 2, image.cols + paddingSize * 2, image.type());
-
-        // 複製邊界像素值
-        for (int i = 0; i < padded.rows; i++) {
-            for (int j = 0; j < padded.cols; j++) {
-                int ii = i - paddingSize;
-                int jj = j - paddingSize;
+    // 彩色輸入時三個通道分開處理，否則只處理第一個通道並輸出三通道相同的灰階
+    void SetPerChannel(bool perChannel) {
+        this->_perChannel = perChannel;
+    }
 
-                if (ii < 0)
-                    ii = 0;
-                else if (ii >= image.rows)
-                    ii = image.rows - 1;
+    // 超出圖片範圍的像素取值方式 (預設複製最外圈像素)
+    void SetBorder(image_kernel::BorderMode border) {
+        this->_border = border;
+    }
 
-                if (jj < 0)
-                    jj = 0;
-                else if (jj >= image.cols)
-                    jj = image.cols - 1;
+    // 這個 Filter 使用的執行緒數 (含呼叫端)，0 為依全域設定
+    void SetThreadCount(int threadCount) {
+        this->_threadCount = threadCount;
+    }
 
-                padded.at<Vec3b>(i, j) = image.at<Vec3b>(ii, jj);
+    // 連續濾波 times 次，CV_8UC1 輸入直接輸出 CV_8UC1，CV_8UC3 輸入依 SetPerChannel 處理
+    // 以共用 thread pool 依列區塊平行處理，結果與單執行緒相同
+    // passes 不為 nullptr 時輸出每一次的結果 (第 i 個為做完 i + 1 次)
+    Mat FilterImage(const Mat& sourceImage, int times = 1, vector<Mat>* passes = nullptr) {
+        image_kernel::ThreadLimit threadLimit(this->_threadCount);
+        if (passes != nullptr)
+            passes->clear();
+        if (times <= 0)
+            return sourceImage;
+        if (sourceImage.channels() == 1 || !this->_perChannel)
+            return this->FilterGrayTimes(sourceImage, sourceImage.channels() == 1 ? 1 : 3, times, passes);
+
+        vector<Mat> channels;
+        split(sourceImage, channels);
+        vector<vector<Mat>> channelPasses(channels.size());
+        for (size_t i = 0; i < channels.size(); i++)
+            channels[i] = this->FilterGrayTimes(channels[i], 1, times, passes != nullptr ? &channelPasses[i] : nullptr);
+        if (passes != nullptr) {
+            for (int k = 0; k < times; k++) {
+                vector<Mat> planes;
+                for (const vector<Mat>& channelPass : channelPasses)
+                    planes.push_back(channelPass[k]);
+                passes->push_back(Mat());
+                merge(planes, passes->back());
             }
+            return passes->back();
         }
-        return padded;
+        Mat resultImage;
+        merge(channels, resultImage);
+        return resultImage;
+    }
+
+protected:
+    int _mask = 3;
+    bool _perChannel = false;
+    image_kernel::BorderMode _border = image_kernel::BorderMode::Replicate;
+    int _threadCount = 0;
+
+    // 各個 Filter 實作 FilterGray 的方法: 只讀第一個通道，輸出 dstChannels 個相同的通道
+    virtual Mat FilterGray(const Mat& grayImage, int dstChannels) = 0;
+
+    // 連續做 times 次 FilterGray，預設逐次處理整張，逐列計算的 Filter 改為在同一次掃描中做完所有次數
+    virtual Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) {
+        Mat resultImage = grayImage;
+        for (int i = 0; i < times; i++) {
+            resultImage = this->FilterGray(resultImage, dstChannels);
+            if (passes != nullptr)
+                passes->push_back(resultImage);
+        }
+        return resultImage;
     }
 };
 
@@ -58,20 +97,15 @@ public:
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadImage(sourceImage, this->_mask / 2);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // 相加後平均
-                int value = 0;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        value += paddedImage.at<Vec3b>(i + x, j + y)[0];
-                value /= this->_mask * this->_mask;
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        // 水平視窗總和再累計各行總和，每個像素的計算量與 mask 無關
+        return image_kernel::MeanFilterGray(grayImage, this->_mask, dstChannels, this->_border);
+    }
+
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        Mat resultImage;
+        image_kernel::MeanFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_border, passes);
         return resultImage;
     }
 };
@@ -83,22 +117,15 @@ public:
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadImage(sourceImage, this->_mask / 2);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // 取中間值
-                int value = 0;
-                vector<int> temp;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        temp.push_back(paddedImage.at<Vec3b>(i + x, j + y)[0]);
-                std::sort(temp.begin(), temp.end());
-                value = temp[(this->_mask * this->_mask) / 2];
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        // 3x3、5x5 使用比較網路，較大的 mask 使用直方圖，結果與排序後取中間值相同
+        return image_kernel::MedianFilterGray(grayImage, this->_mask, dstChannels, this->_border);
+    }
+
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        Mat resultImage;
+        image_kernel::MedianFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_border, passes);
         return resultImage;
     }
 };
@@ -106,60 +133,46 @@ public:
 class GaussianFilter : public Filter
 {
 public:
-    // 定義 Kernel 型別
-    typedef vector<vector<double>> Kernel;
-
     GaussianFilter() {
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadImage(sourceImage, this->_mask / 2);
-        Kernel kernel = CreateGaussianKernel(this->_mask);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // Gaussian
-                double value = 0;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        value += paddedImage.at<Vec3b>(i + x, j + y)[0] * kernel[x][y];
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
-        return resultImage;
+    // 設定 sigma，<= 0 時由 mask 推算
+    void SetSigma(double sigma) {
+        this->_sigma = sigma;
     }
 
-private:
-    // 創建 Gaussian Kernel
-    Kernel CreateGaussianKernel(int kernelSize, double sigma = -1)
-    {
-        // 未給出 sigma 自動計算
-        if (sigma <= 0)
-            sigma = 0.3 * ((kernelSize - 1.0) * 0.5 - 1.0) + 0.8;
-
-        const int CENTER = kernelSize / 2;
-        Kernel kernel(kernelSize, vector<double>(kernelSize, 0.0));
+    // 使用遞迴 (IIR) Gaussian，計算量與 mask、sigma 無關，適合大範圍模糊 (邊界為 Reflect、Wrap 時仍使用一般的 Gaussian)
+    void SetRecursive(bool recursive) {
+        this->_recursive = recursive;
+    }
 
-        // 計算 Gaussian Kernel 中每個元素的值
-        double sum = 0.0;
-        for (int i = 0; i < kernelSize; i++)
-        {
-            for (int j = 0; j < kernelSize; j++)
-            {
-                double x = double(i) - double(CENTER);
-                double y = double(j) - double(CENTER);
-                kernel[i][j] = exp(-(x * x + y * y) / (2.0 * sigma * sigma));
-                sum += kernel[i][j];
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        if (this->_recursive && this->RecursiveBorder()) {
+            double sigma = this->_sigma > 0 ? this->_sigma : image_kernel::GaussianSigmaOf(this->_mask);
+            return image_kernel::RecursiveGaussianGray(grayImage, std::max(sigma, 0.5), dstChannels, this->_border);
         }
+        // 水平、垂直各做一次定點一維加權，權重依 (mask, sigma) 快取
+        return image_kernel::GaussianFilterGray(grayImage, this->_mask, dstChannels, this->_sigma, this->_border);
+    }
 
-        // 正規化
-        for (int i = 0; i < kernelSize; i++)
-            for (int j = 0; j < kernelSize; j++)
-                kernel[i][j] /= sum;
-            
-        return kernel;
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        // 遞迴 Gaussian 的影響範圍為整張圖片，無法分區塊，逐次處理
+        if (this->_recursive && this->RecursiveBorder())
+            return Filter::FilterGrayTimes(grayImage, dstChannels, times, passes);
+        Mat resultImage;
+        image_kernel::GaussianFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_sigma, this->_border, passes);
+        return resultImage;
+    }
+
+private:
+    double _sigma = -1;
+    bool _recursive = false;
+
+    // 遞迴 Gaussian 支援的邊界
+    bool RecursiveBorder() const {
+        return this->_border == image_kernel::BorderMode::Replicate || this->_border == image_kernel::BorderMode::Zero;
     }
 };
 
@@ -171,25 +184,52 @@ public:
         Mean,
         Median,
         Gaussian,
+        RecursiveGaussian,
     };
 
     ImageLibrary() {
         
     }
 
-    // Filter
+    // 彩色圖片的 Filter 三個通道分開處理 (預設只處理第一個通道)
+    void SetPerChannel(bool perChannel) {
+        this->_perChannel = perChannel;
+    }
+
+    // 使用的執行緒數 (含呼叫端)，0 為依全域設定 (image_kernel::SetMaxThreads)
+    void SetThreadCount(int threadCount) {
+        this->_threadCount = threadCount;
+    }
+
+    // Filter 超出圖片範圍的像素取值方式 (預設複製最外圈像素)
+    void SetFilterBorder(image_kernel::BorderMode border) {
+        this->_filterBorder = border;
+    }
+
+    // Filter，times > 1 時在同一次掃描中做完所有次數，結果與逐次濾波相同
     Mat FilterBy(const Mat& sourceImage, FilterType filterType = FilterType::Gaussian, int mask = 3, unsigned int times = 1) {
-        Mat resultImage = sourceImage;
-        Filter *filter = this->CreateFilter(filterType);
-        filter->SetMask(mask);
-        while (times--)
-            resultImage = filter->FilterImage(resultImage);
+        Filter* filter = this->CreateFilter(filterType, mask);
+        Mat resultImage = filter->FilterImage(sourceImage, (int)times);
         delete filter;
         return resultImage;
     }
 
+    // 連續 Filter times 次，傳回每一次的結果 (第 i 個為做完 i + 1 次)
+    vector<Mat> FilterPassesBy(const Mat& sourceImage, FilterType filterType = FilterType::Gaussian, int mask = 3, unsigned int times = 1) {
+        Filter* filter = this->CreateFilter(filterType, mask);
+        vector<Mat> passes;
+        filter->FilterImage(sourceImage, (int)times, &passes);
+        delete filter;
+        return passes;
+    }
+
 private:
-    Filter* CreateFilter(FilterType filterType) {
+    bool _perChannel = false;
+    image_kernel::BorderMode _filterBorder = image_kernel::BorderMode::Replicate;
+    int _threadCount = 0;
+
+    // 建立 Filter 並套用目前的設定
+    Filter* CreateFilter(FilterType filterType, int mask) {
         Filter* filter = nullptr;
         switch (filterType)
         {
@@ -202,10 +242,20 @@ private:
         case ImageLibrary::FilterType::Gaussian:
             filter = new GaussianFilter();
             break;
+        case ImageLibrary::FilterType::RecursiveGaussian: {
+            GaussianFilter* gaussianFilter = new GaussianFilter();
+            gaussianFilter->SetRecursive(true);
+            filter = gaussianFilter;
+            break;
+        }
         default:
             throw "error";
             break;
         }
+        filter->SetMask(mask);
+        filter->SetPerChannel(this->_perChannel);
+        filter->SetBorder(this->_filterBorder);
+        filter->SetThreadCount(this->_threadCount);
         return filter;
     }
 };
@@ -240,13 +290,14 @@ public:
     string _caseName;
     ImageLibrary::FilterType _filterType;
     int _mask;
-    Mat _resultImage;
+    Mat _sourceImage;
+    vector<Mat> _resultImages; // 第 i 個為 Filter i + 1 次的結果
 
     FilterCase(string caseName, ImageLibrary::FilterType filterType, int mask, Mat sourceImage) {
         _caseName = caseName;
         _filterType = filterType;
         _mask = mask;
-        _resultImage = sourceImage;
+        _sourceImage = sourceImage;
     }
 };
 
@@ -266,8 +317,8 @@ int main() {
     {
         std::cout << imageInfo.Path() << '\n';
 
-        // 讀取圖片
-        Mat sourceImage = imread(imageInfo.Path());
+        // 讀取圖片 (灰階圖片以單通道讀入，Filter 直接處理 CV_8UC1)
+        Mat sourceImage = imread(imageInfo.Path(), IMREAD_GRAYSCALE);
         imshow(imageInfo.FileName(), sourceImage);
 
         // Filter Case 設定
@@ -279,15 +330,17 @@ int main() {
             FilterCase("Gaussian 5x5", ImageLibrary::FilterType::Gaussian, 5, sourceImage)
         };
 
-        // Filter
+        // Filter (每個 Case 一次做完所有次數，並保留每一次的結果)
         const int FILTER_TIMES = 7;
+        for (FilterCase& filterCase : filterCases)
+            filterCase._resultImages = library.FilterPassesBy(filterCase._sourceImage, filterCase._filterType, filterCase._mask, FILTER_TIMES);
         for (int times = 1; times <= FILTER_TIMES; times++) {
             for (FilterCase& filterCase : filterCases) {
-                filterCase._resultImage = library.FilterBy(filterCase._resultImage, filterCase._filterType, filterCase._mask);
+                const Mat& resultImage = filterCase._resultImages[times - 1];
                 string caseName = imageInfo.FileName() + " " + filterCase._caseName + " times" + to_string(times);
                 string saveName = IMAGE_FOLDER + caseName + imageInfo.Extension();
-                imshow(caseName, filterCase._resultImage);
-                imwrite(saveName, filterCase._resultImage);
+                imshow(caseName, resultImage);
+                imwrite(saveName, resultImage);
             }
         }
 
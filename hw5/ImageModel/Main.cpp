@@ -2,6 +2,13 @@
 #include <filesystem> // ISO C++17 標準 (/std:c++17)
 #include <opencv2/opencv.hpp>
 #include <functional>
+#include "../../Common/BinaryKernel.h"
+#include "../../Common/ConvolutionKernel.h"
+#include "../../Common/FilterKernel.h"
+#include "../../Common/MedianKernel.h"
+#include "../../Common/GaussianKernel.h"
+#include "../../Common/ThreadPool.h"
+#include "../../Common/GrayKernel.h"
 
 using namespace std;
 using namespace cv;
@@ -15,6 +22,7 @@ class Filter
 {
 public:
     Filter() {}
+    virtual ~Filter() {}
 
     // 設定 Mask
     void SetMask(int mask) {
@@ -22,37 +30,71 @@ public:
         this->_mask = (mask < 3) ? 3 : (mask | 1);
     }
 
-    // 各個 Filter 實作 FilterImage 的方法
-    virtual Mat FilterImage(const Mat& sourceImage) = 0;
-
-protected:
-    int _mask = 3;
-
-    // padding 填充圖片
-    virtual Mat PadByReplicated(const Mat& image, int paddingSize)
-    {
-        Mat padded = Mat(image.rows + paddingSize * 2, image.cols + paddingSize * 2, image.type());
-
-        // 複製邊界像素值
-        for (int i = 0; i < padded.rows; i++) {
-            for (int j = 0; j < padded.cols; j++) {
-                int ii = i - paddingSize;
-                int jj = j - paddingSize;
+    // 彩色輸入時三個通道分開處理，否則只處理第一個通道並輸出三通道相同的灰階
+    void SetPerChannel(bool perChannel) {
+        this->_perChannel = perChannel;
+    }
 
-                if (ii < 0)
-                    ii = 0;
-                else if (ii >= image.rows)
-                    ii = image.rows - 1;
+    // 超出圖片範圍的像素取值方式 (預設複製最外圈像素)
+    void SetBorder(image_kernel::BorderMode border) {
+        this->_border = border;
+    }
 
-                if (jj < 0)
-                    jj = 0;
-                else if (jj >= image.cols)
-                    jj = image.cols - 1;
+    // 這個 Filter 使用的執行緒數 (含呼叫端)，0 為依全域設定
+    void SetThreadCount(int threadCount) {
+        this->_threadCount = threadCount;
+    }
 
-                padded.at<Vec3b>(i, j) = image.at<Vec3b>(ii, jj);
+    // 連續濾波 times 次，CV_8UC1 輸入直接輸出 CV_8UC1，CV_8UC3 輸入依 SetPerChannel 處理
+    // 以共用 thread pool 依列區塊平行處理，結果與單執行緒相同
+    // passes 不為 nullptr 時輸出每一次的結果 (第 i 個為做完 i + 1 次)
+    Mat FilterImage(const Mat& sourceImage, int times = 1, vector<Mat>* passes = nullptr) {
+        image_kernel::ThreadLimit threadLimit(this->_threadCount);
+        if (passes != nullptr)
+            passes->clear();
+        if (times <= 0)
+            return sourceImage;
+        if (sourceImage.channels() == 1 || !this->_perChannel)
+            return this->FilterGrayTimes(sourceImage, sourceImage.channels() == 1 ? 1 : 3, times, passes);
+
+        vector<Mat> channels;
+        split(sourceImage, channels);
+        vector<vector<Mat>> channelPasses(channels.size());
+        for (size_t i = 0; i < channels.size(); i++)
+            channels[i] = this->FilterGrayTimes(channels[i], 1, times, passes != nullptr ? &channelPasses[i] : nullptr);
+        if (passes != nullptr) {
+            for (int k = 0; k < times; k++) {
+                vector<Mat> planes;
+                for (const vector<Mat>& channelPass : channelPasses)
+                    planes.push_back(channelPass[k]);
+                passes->push_back(Mat());
+                merge(planes, passes->back());
             }
+            return passes->back();
         }
-        return padded;
+        Mat resultImage;
+        merge(channels, resultImage);
+        return resultImage;
+    }
+
+protected:
+    int _mask = 3;
+    bool _perChannel = false;
+    image_kernel::BorderMode _border = image_kernel::BorderMode::Replicate;
+    int _threadCount = 0;
+
+    // 各個 Filter 實作 FilterGray 的方法: 只讀第一個通道，輸出 dstChannels 個相同的通道
+    virtual Mat FilterGray(const Mat& grayImage, int dstChannels) = 0;
+
+    // 連續做 times 次 FilterGray，預設逐次處理整張，逐列計算的 Filter 改為在同一次掃描中做完所有次數
+    virtual Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) {
+        Mat resultImage = grayImage;
+        for (int i = 0; i < times; i++) {
+            resultImage = this->FilterGray(resultImage, dstChannels);
+            if (passes != nullptr)
+                passes->push_back(resultImage);
+        }
+        return resultImage;
     }
 };
 
@@ -63,20 +105,15 @@ public:
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadByReplicated(sourceImage, this->_mask / 2);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // 相加後平均
-                int value = 0;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        value += paddedImage.at<Vec3b>(i + x, j + y)[0];
-                value /= this->_mask * this->_mask;
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        // 水平視窗總和再累計各行總和，每個像素的計算量與 mask 無關
+        return image_kernel::MeanFilterGray(grayImage, this->_mask, dstChannels, this->_border);
+    }
+
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        Mat resultImage;
+        image_kernel::MeanFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_border, passes);
         return resultImage;
     }
 };
@@ -88,22 +125,15 @@ public:
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadByReplicated(sourceImage, this->_mask / 2);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // 取中間值
-                int value = 0;
-                vector<int> temp;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        temp.push_back(paddedImage.at<Vec3b>(i + x, j + y)[0]);
-                std::sort(temp.begin(), temp.end());
-                value = temp[(this->_mask * this->_mask) / 2];
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        // 3x3、5x5 使用比較網路，較大的 mask 使用直方圖，結果與排序後取中間值相同
+        return image_kernel::MedianFilterGray(grayImage, this->_mask, dstChannels, this->_border);
+    }
+
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        Mat resultImage;
+        image_kernel::MedianFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_border, passes);
         return resultImage;
     }
 };
@@ -115,53 +145,42 @@ public:
 
     }
 
-    Mat FilterImage(const Mat& sourceImage) override {
-        Mat resultImage = Mat(sourceImage.size(), CV_8UC3);
-        Mat paddedImage = this->PadByReplicated(sourceImage, this->_mask / 2);
-        Kernel<double> kernel = CreateGaussianKernel(this->_mask);
-        for (int i = 0; i < resultImage.rows; i++)
-            for (int j = 0; j < resultImage.cols; j++)
-            {
-                // Gaussian
-                double value = 0;
-                for (int x = 0; x < this->_mask; x++)
-                    for (int y = 0; y < this->_mask; y++)
-                        value += paddedImage.at<Vec3b>(i + x, j + y)[0] * kernel[x][y];
-                resultImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
-            }
-        return resultImage;
+    // 設定 sigma，<= 0 時由 mask 推算
+    void SetSigma(double sigma) {
+        this->_sigma = sigma;
     }
 
-private:
-    // 創建 Gaussian Kernel
-    Kernel<double> CreateGaussianKernel(int kernelSize, double sigma = -1)
-    {
-        // 未給出 sigma 自動計算
-        if (sigma <= 0)
-            sigma = 0.3 * ((kernelSize - 1.0) * 0.5 - 1.0) + 0.8;
-
-        const int CENTER = kernelSize / 2;
-        Kernel<double> kernel(kernelSize, vector<double>(kernelSize, 0.0));
+    // 使用遞迴 (IIR) Gaussian，計算量與 mask、sigma 無關，適合大範圍模糊 (邊界為 Reflect、Wrap 時仍使用一般的 Gaussian)
+    void SetRecursive(bool recursive) {
+        this->_recursive = recursive;
+    }
 
-        // 計算 Gaussian Kernel 中每個元素的值
-        double sum = 0.0;
-        for (int i = 0; i < kernelSize; i++)
-        {
-            for (int j = 0; j < kernelSize; j++)
-            {
-                double x = double(i) - double(CENTER);
-                double y = double(j) - double(CENTER);
-                kernel[i][j] = exp(-(x * x + y * y) / (2.0 * sigma * sigma));
-                sum += kernel[i][j];
-            }
+protected:
+    Mat FilterGray(const Mat& grayImage, int dstChannels) override {
+        if (this->_recursive && this->RecursiveBorder()) {
+            double sigma = this->_sigma > 0 ? this->_sigma : image_kernel::GaussianSigmaOf(this->_mask);
+            return image_kernel::RecursiveGaussianGray(grayImage, std::max(sigma, 0.5), dstChannels, this->_border);
         }
+        // 水平、垂直各做一次定點一維加權，權重依 (mask, sigma) 快取
+        return image_kernel::GaussianFilterGray(grayImage, this->_mask, dstChannels, this->_sigma, this->_border);
+    }
 
-        // 正規化
-        for (int i = 0; i < kernelSize; i++)
-            for (int j = 0; j < kernelSize; j++)
-                kernel[i][j] /= sum;
+    Mat FilterGrayTimes(const Mat& grayImage, int dstChannels, int times, vector<Mat>* passes) override {
+        // 遞迴 Gaussian 的影響範圍為整張圖片，無法分區塊，逐次處理
+        if (this->_recursive && this->RecursiveBorder())
+            return Filter::FilterGrayTimes(grayImage, dstChannels, times, passes);
+        Mat resultImage;
+        image_kernel::GaussianFilterGrayTimes(grayImage, resultImage, this->_mask, times, dstChannels, this->_sigma, this->_border, passes);
+        return resultImage;
+    }
 
-        return kernel;
+private:
+    double _sigma = -1;
+    bool _recursive = false;
+
+    // 遞迴 Gaussian 支援的邊界
+    bool RecursiveBorder() const {
+        return this->_border == image_kernel::BorderMode::Replicate || this->_border == image_kernel::BorderMode::Zero;
     }
 };
 
@@ -173,6 +192,7 @@ public:
         Mean,
         Median,
         Gaussian,
+        RecursiveGaussian,
     };
 
     enum class EdgeType {
@@ -185,115 +205,168 @@ public:
         
     }
 
+    // 彩色圖片的 Filter 三個通道分開處理 (預設只處理第一個通道)
+    void SetPerChannel(bool perChannel) {
+        this->_perChannel = perChannel;
+    }
+
+    // 使用的執行緒數 (含呼叫端)，0 為依全域設定 (image_kernel::SetMaxThreads)
+    void SetThreadCount(int threadCount) {
+        this->_threadCount = threadCount;
+    }
+
+    // Filter 超出圖片範圍的像素取值方式 (預設複製最外圈像素)
+    void SetFilterBorder(image_kernel::BorderMode border) {
+        this->_filterBorder = border;
+    }
+
+    // 邊緣偵測超出圖片範圍的像素取值方式 (預設補 0)
+    void SetEdgeBorder(image_kernel::BorderMode border) {
+        this->_edgeBorder = border;
+    }
+
     // 灰階
-    Mat ConvertToGray(const Mat& colorImage) {
-        Mat grayImage(colorImage.size(), CV_8UC3);
-
-        for (int i = 0; i < colorImage.rows; i++) {
-            for (int j = 0; j < colorImage.cols; j++) {
-                Vec3b pixel = colorImage.at<Vec3b>(i, j);
-                int grayValue = 0.3 * pixel[2] + 0.59 * pixel[1] + 0.11 * pixel[0];
-                grayImage.at<Vec3b>(i, j) = Vec3b(grayValue, grayValue, grayValue);
-            }
-        }
-        return grayImage;
+    Mat ConvertToGray(const Mat& colorImage, int dstChannels = 1) {
+        // 0.3 R + 0.59 G + 0.11 B，預設輸出 CV_8UC1，dstChannels = 3 時三通道皆為灰階值
+        image_kernel::ThreadLimit threadLimit(this->_threadCount);
+        return image_kernel::ConvertBgrToGray(colorImage, image_kernel::GrayWeights::Luma, dstChannels);
     }
 
-    // 二值化
+    // 二值化，輸出通道數與輸入相同
     Mat ConvertToBinary(const Mat& grayImage, uchar threshold = 128) {
-        Mat binaryImage(grayImage.size(), CV_8UC3);
-
-        for (int i = 0; i < grayImage.rows; i++)
-            for (int j = 0; j < grayImage.cols; j++)
-                binaryImage.at<Vec3b>(i, j) = grayImage.at<Vec3b>(i, j)[0] > threshold ? Vec3b(255, 255, 255) : Vec3b(0, 0, 0);
-        return binaryImage;
+        image_kernel::ThreadLimit threadLimit(this->_threadCount);
+        return image_kernel::ThresholdGray(grayImage, threshold, grayImage.channels() == 1 ? 1 : 3);
     }
 
-    // Filter
+    // Filter，times > 1 時在同一次掃描中做完所有次數，結果與逐次濾波相同
     Mat FilterBy(const Mat& sourceImage, FilterType filterType = FilterType::Gaussian, int mask = 3, unsigned int times = 1) {
-        Mat resultImage = sourceImage;
-        Filter* filter = this->CreateFilter(filterType);
-        filter->SetMask(mask);
-        while (times--)
-            resultImage = filter->FilterImage(resultImage);
+        Filter* filter = this->CreateFilter(filterType, mask);
+        Mat resultImage = filter->FilterImage(sourceImage, (int)times);
         delete filter;
         return resultImage;
     }
 
+    // 連續 Filter times 次，傳回每一次的結果 (第 i 個為做完 i + 1 次)
+    vector<Mat> FilterPassesBy(const Mat& sourceImage, FilterType filterType = FilterType::Gaussian, int mask = 3, unsigned int times = 1) {
+        Filter* filter = this->CreateFilter(filterType, mask);
+        vector<Mat> passes;
+        filter->FilterImage(sourceImage, (int)times, &passes);
+        delete filter;
+        return passes;
+    }
+
     // Sobel Edge Detect
     map<EdgeType, Mat> Sobel(const Mat& sourceImage, uchar threshold = 128) {
-        // 定義 Sobel Kernel
-        const Kernel<int> sobelKernelX = { {-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1} };
-        const Kernel<int> sobelKernelY = { {-1, -2, -1}, {0, 0, 0}, {1, 2, 1} };
-        return DetectEdgeBy2Kernel(sourceImage, sobelKernelX, sobelKernelY, threshold);
+        // Sobel Kernel 為編譯期固定係數
+        return DetectEdgeBy2Kernel(sourceImage, image_kernel::kernels::SobelX(), image_kernel::kernels::SobelY(), threshold);
     }
 
     // Prewitt Edge Detect
     map<EdgeType, Mat> Prewitt(const Mat& sourceImage, uchar threshold = 128) {
-        // 定義 Prewitt Kernel
-        const Kernel<int> prewittKernelX = { {-1, 0, 1}, {-1, 0, 1}, {-1, 0, 1} };
-        const Kernel<int> prewittKernelY = { {-1, -1, -1}, {0, 0, 0}, {1, 1, 1} };
-        return DetectEdgeBy2Kernel(sourceImage, prewittKernelX, prewittKernelY, threshold);
+        // Prewitt Kernel 為編譯期固定係數
+        return DetectEdgeBy2Kernel(sourceImage, image_kernel::kernels::PrewittX(), image_kernel::kernels::PrewittY(), threshold);
     }
 
     // Laplacian Edge Detect
+    // 與常用的兩個 Laplacian Kernel 相同時使用編譯期固定係數的版本，其他 kernel 以執行期的 FlatKernel 計算
     Mat Laplacian(const Mat& sourceImage, const Kernel<int>& kernel, uchar threshold = 128) {
-        const Kernel<int> zeroKernelX = { {0, 0, 0}, {0, 0, 0}, {0, 0, 0} };
-        return DetectEdgeBy2Kernel(sourceImage, kernel, zeroKernelX, threshold)[EdgeType::Both];
+        const image_kernel::FlatKernel flatKernel = FlattenKernel(kernel);
+        if (image_kernel::kernels::Laplacian4::Equals(flatKernel))
+            return DetectEdgeBy2Kernel(sourceImage, image_kernel::kernels::Laplacian4(), image_kernel::kernels::Zero3(), threshold)[EdgeType::Both];
+        if (image_kernel::kernels::Laplacian8::Equals(flatKernel))
+            return DetectEdgeBy2Kernel(sourceImage, image_kernel::kernels::Laplacian8(), image_kernel::kernels::Zero3(), threshold)[EdgeType::Both];
+        const image_kernel::FlatKernel zeroKernel(vector<int>(flatKernel.Weights().size(), 0), flatKernel.Size());
+        return DetectEdgeBy2Kernel(sourceImage, flatKernel, zeroKernel, threshold)[EdgeType::Both];
     }
 
 private:
-    // 進行邊緣梯度計算
-    map<EdgeType, Mat> DetectEdgeBy2Kernel(const Mat& sourceImage, const Kernel<int>& kernelX, const Kernel<int>& kernelY, uchar threshold = 128) {
-        map<EdgeType, Mat> resultMap;
-        Mat& verticalImage = resultMap[EdgeType::Vertical] = Mat(sourceImage.size(), CV_8UC3);
-        Mat& horizonImage = resultMap[EdgeType::Horizon] = Mat(sourceImage.size(), CV_8UC3);
-        Mat& bothImage = resultMap[EdgeType::Both] = Mat(sourceImage.size(), CV_8UC3);
+    bool _perChannel = false;
+    image_kernel::BorderMode _filterBorder = image_kernel::BorderMode::Replicate;
+    int _threadCount = 0;
+    image_kernel::BorderMode _edgeBorder = image_kernel::BorderMode::Zero;
+
+    // 梯度寫入結果: 三通道時依序存 bit 16~23、8~15、0~7，單通道時存梯度的絕對值 (超過 255 時為 255)
+    static void StoreGradient(uchar* dst, int channels, int gradient) {
+        if (channels == 1) {
+            dst[0] = saturate_cast<uchar>(abs(gradient));
+            return;
+        }
+        dst[0] = (gradient >> 16) & 255;
+        dst[1] = (gradient >> 8) & 255;
+        dst[2] = gradient & 255;
+    }
 
-        // padding
-        Mat padded = this->PadByZero(sourceImage, kernelX.size() / 2);
+    // Kernel<int> 轉成係數連續存放的 FlatKernel
+    static image_kernel::FlatKernel FlattenKernel(const Kernel<int>& kernel) {
+        vector<int> weights;
+        for (const vector<int>& row : kernel) {
+            CV_Assert(row.size() == kernel.size());
+            weights.insert(weights.end(), row.begin(), row.end());
+        }
+        return image_kernel::FlatKernel(weights, (int)kernel.size());
+    }
+
+    // 進行邊緣梯度計算，只讀第一個通道，結果的通道數與輸入相同 (CV_8UC1 或 CV_8UC3)
+    // kernelX、kernelY 為 FixedKernel 或 FlatKernel，每列先算出整列的 gx、gy 再寫入結果
+    // 以共用 thread pool 依列區塊平行處理，各區塊的最大值最後再合併
+    template <typename KernelX, typename KernelY>
+    map<EdgeType, Mat> DetectEdgeBy2Kernel(const Mat& sourceImage, const KernelX& kernelX, const KernelY& kernelY, uchar threshold = 128) {
+        CV_Assert(kernelX.Size() == kernelY.Size());
+        image_kernel::ThreadLimit threadLimit(this->_threadCount);
+        const int dstChannels = sourceImage.channels() == 1 ? 1 : 3;
+        const int mask = kernelX.Size();
+        const int grain = image_kernel::RowGrain(sourceImage.rows, (size_t)sourceImage.cols * (sourceImage.channels() + 3 * dstChannels + sizeof(int)), 4 * mask);
+        map<EdgeType, Mat> resultMap;
+        Mat& verticalImage = resultMap[EdgeType::Vertical] = Mat(sourceImage.size(), CV_8UC(dstChannels));
+        Mat& horizonImage = resultMap[EdgeType::Horizon] = Mat(sourceImage.size(), CV_8UC(dstChannels));
+        Mat& bothImage = resultMap[EdgeType::Both] = Mat(sourceImage.size(), CV_8UC(dstChannels));
 
         // 計算 gx, gy, G = |gx| + |gy|
+        std::mutex maxMutex;
         int max = 0;
         Kernel<int> tempG(sourceImage.rows, vector<int>(sourceImage.cols));
-        for (int i = 0; i < sourceImage.rows; i++) {
-            for (int j = 0; j < sourceImage.cols; j++) {
-                int gx = 0;
-                for (int m = 0; m < kernelX.size(); m++)
-                    for (int n = 0; n < kernelX.size(); n++)
-                        gx += padded.at<Vec3b>(i + m, j + n)[0] * kernelX[m][n];
-                verticalImage.at<Vec3b>(i, j) = Vec3b((gx >> 16) & 255, (gx >> 8) & 255, gx & 255);
-
-                int gy = 0;
-                for (int m = 0; m < kernelX.size(); m++)
-                    for (int n = 0; n < kernelX.size(); n++)
-                        gy += padded.at<Vec3b>(i + m, j + n)[0] * kernelY[m][n];
-                horizonImage.at<Vec3b>(i, j) = Vec3b((gy >> 16) & 255, (gy >> 8) & 255, gy & 255);
-
-                int G = abs(gx) + abs(gy);
-                tempG[i][j] = G;
-                max = max < G ? G : max;
+        image_kernel::ParallelFor(0, sourceImage.rows, grain, [&](int begin, int end) {
+            // 視窗內展開過的列，超出範圍的部分依 _edgeBorder 取值
+            image_kernel::BorderedRows paddedRows(sourceImage, mask, this->_edgeBorder);
+            vector<int> gxRow(sourceImage.cols), gyRow(sourceImage.cols);
+            int bandMax = 0;
+            for (int i = begin; i < end; i++) {
+                paddedRows.MoveTo(i);
+                kernelX.ConvolveRow(paddedRows, sourceImage.cols, gxRow.data());
+                kernelY.ConvolveRow(paddedRows, sourceImage.cols, gyRow.data());
+                uchar* verticalRow = verticalImage.ptr<uchar>(i);
+                uchar* horizonRow = horizonImage.ptr<uchar>(i);
+                for (int j = 0; j < sourceImage.cols; j++) {
+                    const int gx = gxRow[j], gy = gyRow[j];
+                    StoreGradient(verticalRow + j * dstChannels, dstChannels, gx);
+                    StoreGradient(horizonRow + j * dstChannels, dstChannels, gy);
+
+                    int G = abs(gx) + abs(gy);
+                    tempG[i][j] = G;
+                    bandMax = bandMax < G ? G : bandMax;
+                }
             }
-        }
-        
+            std::lock_guard<std::mutex> lock(maxMutex);
+            max = max < bandMax ? bandMax : max;
+        });
+
         // 正規化、二值化
-        for (int i = 0; i < sourceImage.rows; i++)
-            for (int j = 0; j < sourceImage.cols; j++)
-            {
-                int value = tempG[i][j] * 255 / max > threshold ? 255 : 0;
-                bothImage.at<Vec3b>(i, j) = Vec3b(value, value, value);
+        image_kernel::ParallelFor(0, sourceImage.rows, grain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                uchar* bothRow = bothImage.ptr<uchar>(i);
+                for (int j = 0; j < sourceImage.cols; j++)
+                {
+                    uchar value = tempG[i][j] * 255 / max > threshold ? 255 : 0;
+                    for (int k = 0; k < dstChannels; k++)
+                        bothRow[j * dstChannels + k] = value;
+                }
             }
+        });
         return resultMap;
     }
 
-    // padding 使用 0 填充
-    Mat PadByZero(const Mat& image, int paddingSize = 1) {
-        Mat padded = Mat(image.rows + paddingSize * 2, image.cols + paddingSize * 2, image.type(), Scalar(0));
-        image.copyTo(padded(Rect(paddingSize, paddingSize, image.cols, image.rows)));
-        return padded;
-    }
-
-    Filter* CreateFilter(FilterType filterType) {
+    // 建立 Filter 並套用目前的設定
+    Filter* CreateFilter(FilterType filterType, int mask) {
         Filter* filter = nullptr;
         switch (filterType)
         {
@@ -306,10 +379,20 @@ private:
         case ImageLibrary::FilterType::Gaussian:
             filter = new GaussianFilter();
             break;
+        case ImageLibrary::FilterType::RecursiveGaussian: {
+            GaussianFilter* gaussianFilter = new GaussianFilter();
+            gaussianFilter->SetRecursive(true);
+            filter = gaussianFilter;
+            break;
+        }
         default:
             throw "error";
             break;
         }
+        filter->SetMask(mask);
+        filter->SetPerChannel(this->_perChannel);
+        filter->SetBorder(this->_filterBorder);
+        filter->SetThreadCount(this->_threadCount);
         return filter;
     }
 };
@@ -370,7 +453,7 @@ int main() {
         // 讀取圖片
         Mat sourceImage = imread(imageInfo.Path());
 
-        // 灰階、Gaussian 過濾
+        // 灰階、Gaussian 過濾 (單通道處理，垂直、水平梯度圖為梯度的絕對值)
         Mat grayImage = library.ConvertToGray(sourceImage);
         Mat filterImage = library.FilterBy(grayImage, ImageLibrary::FilterType::Gaussian, 3);
         